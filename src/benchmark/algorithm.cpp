@@ -0,0 +1,82 @@
+#include <ice/algorithm.hpp>
+#include <ice/async.hpp>
+#include <ice/context_pool.hpp>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+constexpr std::size_t size = 1 << 20;
+
+static std::uint64_t hash(std::uint64_t value) noexcept
+{
+  for (auto i = 0; i < 16; i++) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCD;
+  }
+  return value;
+}
+
+// Hashes the elements of a range with range(0) contexts.
+static void algorithm_for(benchmark::State& state) noexcept
+{
+  ice::context_pool pool;
+  if (const auto ec = pool.create(static_cast<std::size_t>(state.range(0)))) {
+    state.SkipWithError(ec.message().data());
+  }
+  std::vector<std::uint64_t> values(size);
+  std::iota(values.begin(), values.end(), 0);
+  for (auto _ : state) {
+    [&]() -> ice::sync<void> {
+      co_await ice::parallel_for(pool, values.begin(), values.end(), [](std::uint64_t& value) { value = hash(value); });
+    }().get();
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * size));
+}
+BENCHMARK(algorithm_for)->DenseRange(1, static_cast<int>(std::thread::hardware_concurrency()))->UseRealTime();
+
+// Sums the hashes of the elements of a range with range(0) contexts.
+static void algorithm_reduce(benchmark::State& state) noexcept
+{
+  ice::context_pool pool;
+  if (const auto ec = pool.create(static_cast<std::size_t>(state.range(0)))) {
+    state.SkipWithError(ec.message().data());
+  }
+  std::vector<std::uint64_t> values(size);
+  std::iota(values.begin(), values.end(), 0);
+  for (auto _ : state) {
+    [&]() -> ice::sync<void> {
+      const auto sum = co_await ice::transform_reduce(pool, values.begin(), values.end(), std::uint64_t(0),
+        std::plus<>{}, hash);
+      benchmark::DoNotOptimize(sum);
+    }().get();
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * size));
+}
+BENCHMARK(algorithm_reduce)->DenseRange(1, static_cast<int>(std::thread::hardware_concurrency()))->UseRealTime();
+
+// Sorts a shuffled range with range(0) contexts.
+static void algorithm_sort(benchmark::State& state) noexcept
+{
+  ice::context_pool pool;
+  if (const auto ec = pool.create(static_cast<std::size_t>(state.range(0)))) {
+    state.SkipWithError(ec.message().data());
+  }
+  std::vector<std::uint64_t> values(size);
+  std::iota(values.begin(), values.end(), 0);
+  std::mt19937_64 random{ 0 };
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::shuffle(values.begin(), values.end(), random);
+    state.ResumeTiming();
+    [&]() -> ice::sync<void> {
+      co_await ice::sort(pool, values.begin(), values.end());
+    }().get();
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * size));
+}
+BENCHMARK(algorithm_sort)->DenseRange(1, static_cast<int>(std::thread::hardware_concurrency()))->UseRealTime();
@@ -0,0 +1,145 @@
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <ice/frame.hpp>
+#include <ice/when.hpp>
+#include <benchmark/benchmark.h>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Coroutine frame allocator that forwards to Allocator or to the global allocation functions if it is void. Counts the
+// frames of the calling thread that are allocated from the heap. Frames that were returned to ice::frame_pool are
+// assumed to be reused by the next allocation, which holds for the single frame size and thread of these benchmarks.
+template <typename Allocator>
+class counted {
+public:
+  static void* allocate(std::size_t size)
+  {
+    if constexpr (std::is_void_v<Allocator>) {
+      allocations++;
+      return ::operator new(size);
+    } else {
+      if (cached_) {
+        cached_--;
+      } else {
+        allocations++;
+      }
+      return Allocator::allocate(size);
+    }
+  }
+
+  static void deallocate(void* frame, std::size_t size) noexcept
+  {
+    if constexpr (std::is_void_v<Allocator>) {
+      ::operator delete(frame);
+    } else {
+      cached_++;
+      Allocator::deallocate(frame, size);
+    }
+  }
+
+  static inline thread_local std::size_t allocations = 0;
+
+private:
+  static inline thread_local std::size_t cached_ = 0;
+};
+
+// Reports the heap allocated frames per iteration.
+template <typename Allocator>
+class allocation_counter {
+public:
+  allocation_counter(benchmark::State& state) noexcept : state_(state), allocations_(counted<Allocator>::allocations) {}
+
+  allocation_counter(const allocation_counter& other) = delete;
+  allocation_counter& operator=(const allocation_counter& other) = delete;
+
+  ~allocation_counter()
+  {
+    const auto count = static_cast<double>(counted<Allocator>::allocations - allocations_);
+    state_.counters["allocations"] = count / static_cast<double>(state_.iterations());
+  }
+
+private:
+  benchmark::State& state_;
+  const std::size_t allocations_;
+};
+
+// Calls a coroutine and blocks until it returns a value.
+template <typename Allocator>
+static void async_sync(benchmark::State& state) noexcept
+{
+  auto value = [](int i) -> ice::sync<int, counted<Allocator>> {
+    co_return i;
+  };
+  int i = 0;
+  allocation_counter<Allocator> counter{ state };
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(value(i++).get());
+  }
+}
+BENCHMARK_TEMPLATE(async_sync, void);
+BENCHMARK_TEMPLATE(async_sync, ice::frame_pool);
+
+// Awaits a lazy coroutine that returns a value.
+template <typename Allocator>
+static void async_task(benchmark::State& state) noexcept
+{
+  auto value = [](int i) -> ice::task<int, counted<Allocator>> {
+    co_return i;
+  };
+  auto task = [&]() -> ice::sync<void> {
+    int i = 0;
+    allocation_counter<Allocator> counter{ state };
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(co_await value(i++));
+    }
+  };
+  task().get();
+}
+BENCHMARK_TEMPLATE(async_task, void);
+BENCHMARK_TEMPLATE(async_task, ice::frame_pool);
+
+// Fans out 1024 tasks across two contexts and awaits them one by one or with when_all when range(0) is not zero.
+static void async_fanout(benchmark::State& state) noexcept
+{
+  constexpr std::size_t size = 1024;
+  const auto all = state.range(0) != 0;
+  ice::context c0;
+  ice::context c1;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto t1 = std::thread([&]() { c1.run(); });
+  auto value = [](ice::context& context, std::size_t i) -> ice::task<std::size_t, ice::frame_pool> {
+    co_await ice::schedule(context, true);
+    co_return i;
+  };
+  auto task = [&]() -> ice::sync<void> {
+    std::vector<ice::task<std::size_t, ice::frame_pool>> tasks;
+    tasks.reserve(size);
+    for (auto _ : state) {
+      tasks.clear();
+      for (std::size_t i = 0; i < size; i++) {
+        tasks.push_back(value(i % 2 ? c1 : c0, i));
+      }
+      std::size_t sum = 0;
+      if (all) {
+        co_await ice::when_all(tasks);
+        for (auto& task : tasks) {
+          sum += task.get();
+        }
+      } else {
+        for (auto& task : tasks) {
+          sum += co_await task;
+        }
+      }
+      benchmark::DoNotOptimize(sum);
+    }
+    c0.stop();
+    c1.stop();
+  };
+  task().get();
+  t0.join();
+  t1.join();
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * size));
+}
+BENCHMARK(async_fanout)->Arg(0)->Arg(1)->UseRealTime();
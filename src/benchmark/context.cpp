@@ -1,8 +1,18 @@
 #include <ice/async.hpp>
 #include <ice/context.hpp>
+#include <ice/context_pool.hpp>
+#include <ice/mutex.hpp>
 #include <ice/utility.hpp>
 #include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <thread>
+#include <vector>
 
 // ------------------------------------------------------------------------------------
 // Benchmark                                             Time           CPU Iterations
@@ -62,6 +72,31 @@ static void context_append(benchmark::State& state) noexcept
 }
 BENCHMARK(context_append)->Threads(1)->Iterations(iterations);
 
+// Switches between coroutines that yield on the current context.
+static void context_yield(benchmark::State& state) noexcept
+{
+  constexpr std::size_t switches = 1024;
+  const auto tasks = static_cast<std::size_t>(state.range(0));
+  for (auto _ : state) {
+    ice::context c0;
+    std::size_t count = 0;
+    auto co = [&]() -> ice::detached {
+      for (std::size_t i = 0; i < switches; i++) {
+        co_await ice::schedule(c0, true);
+      }
+      if (++count == tasks) {
+        c0.stop();
+      }
+    };
+    for (std::size_t i = 0; i < tasks; i++) {
+      co();
+    }
+    c0.run();
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * tasks * switches));
+}
+BENCHMARK(context_yield)->Arg(2)->Arg(64);
+
 // Switches to the first context.
 // Switches to the first context.
 // Switches to the second context.
@@ -128,3 +163,265 @@ static void context_always(benchmark::State& state) noexcept
   co.get();
 }
 BENCHMARK(context_always)->Threads(1)->Iterations(iterations);
+
+// Resumes coroutines on a context that is run by multiple threads.
+static void context_stealing(benchmark::State& state) noexcept
+{
+  constexpr std::size_t tasks = 1024;
+  constexpr std::size_t switches = 256;
+  const auto threads = static_cast<std::size_t>(state.range(0));
+  for (auto _ : state) {
+    ice::context c0{ threads };
+    std::atomic_size_t count = 0;
+    auto co = [&]() -> ice::detached {
+      for (std::size_t i = 0; i < switches; i++) {
+        co_await ice::schedule(c0, true);
+        auto value = i;
+        for (std::size_t j = 0; j < 256; j++) {
+          value = value * 31 + j;
+        }
+        benchmark::DoNotOptimize(value);
+      }
+      if (count.fetch_add(1, std::memory_order_relaxed) + 1 == tasks) {
+        c0.stop();
+      }
+    };
+    for (std::size_t i = 0; i < tasks; i++) {
+      co();
+    }
+    std::vector<std::thread> pool;
+    for (std::size_t i = 0; i < threads; i++) {
+      pool.emplace_back([&]() { c0.run(); });
+      if (const auto ec = ice::set_thread_affinity(pool.back(), i)) {
+        state.SkipWithError(ec.message().data());
+      }
+    }
+    for (auto& thread : pool) {
+      thread.join();
+    }
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * tasks * switches));
+}
+BENCHMARK(context_stealing)->DenseRange(1, static_cast<int>(std::thread::hardware_concurrency()))->UseRealTime();
+
+// Schedules range(0) events onto a context run by another thread one by one or as a batch when range(1) is not zero.
+static void context_fanout(benchmark::State& state) noexcept
+{
+  const auto tasks = static_cast<std::size_t>(state.range(0));
+  const auto batch = state.range(1) != 0;
+  ice::context c0;
+  auto t0 = std::thread([&]() { c0.run(); });
+  if (const auto ec = ice::set_thread_affinity(t0, 0)) {
+    state.SkipWithError(ec.message().data());
+  }
+  std::vector<ice::context::event*> events;
+  events.reserve(tasks);
+  std::atomic_size_t count = 0;
+  auto co = [&]() -> ice::detached {
+    co_await ice::defer{ events };
+    count.fetch_add(1, std::memory_order_release);
+  };
+  for (auto _ : state) {
+    state.PauseTiming();
+    events.clear();
+    count.store(0, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < tasks; i++) {
+      co();
+    }
+    state.ResumeTiming();
+    if (batch) {
+      c0.schedule(events.begin(), events.end());
+    } else {
+      for (const auto ev : events) {
+        c0.schedule(ev);
+      }
+    }
+    while (count.load(std::memory_order_acquire) != tasks) {
+      std::this_thread::yield();
+    }
+  }
+  c0.stop();
+  t0.join();
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * tasks));
+}
+BENCHMARK(context_fanout)->Args({ 256, 0 })->Args({ 256, 1 })->UseRealTime();
+
+// Measures the time between scheduling and resuming events that arrive in bursts. Percentiles are computed from a fixed
+// size reservoir of uniformly sampled waits.
+static void context_latency(benchmark::State& state) noexcept
+{
+  using clock = std::chrono::steady_clock;
+  constexpr std::size_t capacity = 1 << 16;
+  const auto burst = static_cast<std::size_t>(state.range(0));
+  ice::context c0;
+  auto t0 = std::thread([&]() { c0.run(); });
+  if (const auto ec = ice::set_thread_affinity(t0, 0)) {
+    state.SkipWithError(ec.message().data());
+  }
+  std::vector<clock::duration> waits(burst);
+  std::vector<clock::duration> samples;
+  samples.reserve(capacity);
+  std::minstd_rand random;
+  std::size_t seen = 0;
+  clock::duration max{};
+  std::atomic_size_t count = 0;
+  auto co = [&](clock::duration& wait) -> ice::detached {
+    const auto start = clock::now();
+    co_await ice::schedule(c0);
+    wait = clock::now() - start;
+    count.fetch_add(1, std::memory_order_release);
+  };
+  for (auto _ : state) {
+    count.store(0, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < burst; i++) {
+      co(waits[i]);
+    }
+    while (count.load(std::memory_order_acquire) != burst) {
+      std::this_thread::yield();
+    }
+    for (const auto wait : waits) {
+      max = std::max(max, wait);
+      if (samples.size() < capacity) {
+        samples.push_back(wait);
+      } else if (const auto index = random() % (seen + 1); index < capacity) {
+        samples[index] = wait;
+      }
+      seen++;
+    }
+  }
+  c0.stop();
+  t0.join();
+  std::sort(samples.begin(), samples.end());
+  const auto ns = [&](double percentile) {
+    const auto index = static_cast<std::size_t>(percentile * static_cast<double>(samples.size() - 1));
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(samples[index]).count());
+  };
+  state.counters["p50_ns"] = ns(0.50);
+  state.counters["p99_ns"] = ns(0.99);
+  state.counters["max_ns"] = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(max).count());
+  state.SetItemsProcessed(static_cast<std::int64_t>(seen));
+}
+BENCHMARK(context_latency)->Arg(16)->Arg(256)->Arg(4096)->UseRealTime();
+
+// Inserts and cancels a timer while other timers are pending.
+static void context_timers(benchmark::State& state) noexcept
+{
+  using namespace std::chrono_literals;
+  const auto count = static_cast<std::size_t>(state.range(0));
+  ice::context c0;
+  auto timers = std::make_unique<std::optional<ice::sleep_for>[]>(count + 1);
+  auto sleep = [&](std::optional<ice::sleep_for>& timer, std::chrono::seconds duration) -> ice::detached {
+    auto& awaitable = timer.emplace(c0, duration);
+    co_await awaitable;
+  };
+  auto lambda = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0);
+    for (std::size_t i = 0; i < count; i++) {
+      sleep(timers[i], 1h + std::chrono::seconds(i));
+    }
+    for (auto _ : state) {
+      sleep(timers[count], 1min);
+      timers[count]->cancel();
+      co_await ice::schedule(c0, true);
+    }
+    for (std::size_t i = 0; i < count; i++) {
+      timers[i]->cancel();
+    }
+    co_await ice::schedule(c0, true);
+    c0.stop();
+  };
+  auto co = lambda();
+  c0.run();
+  co.get();
+}
+BENCHMARK(context_timers)->Arg(0)->Arg(1000)->Arg(100000);
+
+// Moves coroutines between the contexts of a pool.
+static void context_pool(benchmark::State& state) noexcept
+{
+  constexpr std::size_t tasks = 1024;
+  constexpr std::size_t switches = 64;
+  const auto policy = static_cast<ice::context_pool::policy>(state.range(0));
+  ice::context_pool pool{ policy };
+  if (const auto ec = pool.create()) {
+    state.SkipWithError(ec.message().data());
+  }
+  std::atomic_size_t count = 0;
+  auto co = [&]() -> ice::detached {
+    for (std::size_t i = 0; i < switches; i++) {
+      co_await ice::schedule(pool, true);
+    }
+    count.fetch_add(1, std::memory_order_release);
+  };
+  for (auto _ : state) {
+    count.store(0, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < tasks; i++) {
+      co();
+    }
+    while (count.load(std::memory_order_acquire) != tasks) {
+      std::this_thread::yield();
+    }
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * tasks * switches));
+}
+BENCHMARK(context_pool)->Arg(0)->Arg(1)->UseRealTime();
+
+// Increments a shared value under a lock from coroutines on a context run by range(0) threads. Uses std::mutex when
+// range(1) is zero and ice::async_mutex otherwise.
+static void context_mutex(benchmark::State& state) noexcept
+{
+  constexpr std::size_t tasks = 64;
+  constexpr std::size_t iterations = 1024;
+  const auto threads = static_cast<std::size_t>(state.range(0));
+  const auto async = state.range(1) != 0;
+  std::mutex mutex;
+  ice::async_mutex async_mutex;
+  std::size_t value = 0;
+  const auto update = [&]() noexcept {
+    auto v = value;
+    for (std::size_t j = 0; j < 64; j++) {
+      v = v * 31 + j;
+    }
+    benchmark::DoNotOptimize(v);
+    value++;
+  };
+  for (auto _ : state) {
+    ice::context c0{ threads };
+    std::atomic_size_t count = 0;
+    auto co = [&]() -> ice::detached {
+      co_await ice::schedule(c0, true);
+      for (std::size_t i = 0; i < iterations; i++) {
+        if (async) {
+          auto lock = co_await async_mutex.scoped_lock();
+          update();
+        } else {
+          std::lock_guard lock{ mutex };
+          update();
+        }
+        if (i % 16 == 0) {
+          co_await ice::schedule(c0, true);
+        }
+      }
+      if (count.fetch_add(1, std::memory_order_relaxed) + 1 == tasks) {
+        c0.stop();
+      }
+    };
+    for (std::size_t i = 0; i < tasks; i++) {
+      co();
+    }
+    std::vector<std::thread> pool;
+    for (std::size_t i = 0; i < threads; i++) {
+      pool.emplace_back([&]() { c0.run(); });
+      if (const auto ec = ice::set_thread_affinity(pool.back(), i)) {
+        state.SkipWithError(ec.message().data());
+      }
+    }
+    for (auto& thread : pool) {
+      thread.join();
+    }
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * tasks * iterations));
+}
+BENCHMARK(context_mutex)
+  ->ArgsProduct({ benchmark::CreateDenseRange(1, static_cast<int>(std::thread::hardware_concurrency()), 1), { 0, 1 } })
+  ->UseRealTime();
@@ -0,0 +1,313 @@
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <ice/net/tcp/socket.hpp>
+#include <ice/net/udp/socket.hpp>
+#include <ice/service.hpp>
+#include <ice/service_pool.hpp>
+#include <ice/utility.hpp>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Sends range(0) bytes over a loopback connection and waits for the echo. On Linux, range(1) selects the service
+// backend: epoll, io_uring or io_uring with SQPOLL.
+static void net_echo(benchmark::State& state) noexcept
+{
+  const auto size = static_cast<std::size_t>(state.range(0));
+  ice::service s0;
+#if ICE_OS_LINUX
+  const auto backend = static_cast<ice::service::backend_type>(state.range(1));
+  if (const auto ec = s0.create(backend)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  if (s0.backend() != backend) {
+    state.SkipWithError("backend not supported");
+    return;
+  }
+#else
+  if (const auto ec = s0.create()) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+#endif
+  ice::net::endpoint endpoint;
+  ice::net::tcp::acceptor acceptor{ s0 };
+  if (const auto ec = endpoint.create("127.0.0.1", 0)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  if (const auto ec = acceptor.listen(endpoint)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  if (const auto ec = acceptor.local(endpoint)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  ice::context c0;
+  auto t0 = std::thread([&]() { s0.run(c0); });
+  if (const auto ec = ice::set_thread_affinity(t0, 0)) {
+    state.SkipWithError(ec.message().data());
+  }
+  auto server = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    ice::net::tcp::socket socket{ s0 };
+    if (co_await acceptor.accept(socket)) {
+      co_return;
+    }
+    std::vector<char> buffer(64 * 1024);
+    while (true) {
+      const auto [received, ec] = co_await socket.recv(buffer.data(), buffer.size());
+      if (ec || (co_await socket.send(buffer.data(), received)).ec) {
+        break;
+      }
+    }
+  };
+  auto client = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    ice::net::tcp::socket socket{ s0 };
+    if (const auto ec = co_await socket.connect(endpoint)) {
+      state.SkipWithError(ec.message().data());
+      co_return;
+    }
+    socket.set(IPPROTO_TCP, TCP_NODELAY, 1);
+    std::vector<char> data(size);
+    for (auto _ : state) {
+      if ((co_await socket.send(data.data(), size)).ec) {
+        state.SkipWithError("send failed");
+        break;
+      }
+      for (std::size_t received = 0; received < size;) {
+        const auto result = co_await socket.recv(data.data() + received, size - received);
+        if (result.ec) {
+          state.SkipWithError("recv failed");
+          co_return;
+        }
+        received += result.size;
+      }
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * size));
+  };
+  auto s = server();
+  auto c = client();
+  c.get();
+  s.get();
+  s0.stop();
+  t0.join();
+}
+#if ICE_OS_LINUX
+BENCHMARK(net_echo)->ArgsProduct({ { 64, 4096, 65536 }, { 0, 1, 2 } })->UseRealTime();
+#else
+BENCHMARK(net_echo)->Arg(64)->Arg(4096)->Arg(65536)->UseRealTime();
+#endif
+
+// Accepts connections on range(0) shards that listen on the same port with SO_REUSEPORT. Every shard also connects
+// to the port in a loop, so that every shard both connects and accepts. The server resets accepted connections and the
+// client waits for the reset, which keeps sockets in TIME_WAIT from limiting the rate. Errors are collected by the
+// shards and reported by the benchmark thread.
+static void net_accept(benchmark::State& state) noexcept
+{
+  constexpr std::size_t batch = 64;
+  const auto shards = static_cast<std::size_t>(state.range(0));
+  ice::service_pool pool;
+  if (const auto ec = pool.create(shards)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  ice::net::endpoint endpoint;
+  if (const auto ec = endpoint.create("127.0.0.1", 0)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  std::vector<ice::net::tcp::acceptor> acceptors;
+  for (std::size_t i = 0; i < shards; i++) {
+    acceptors.emplace_back(pool[i].service());
+    if (const auto ec = acceptors.back().listen(endpoint, SOMAXCONN, true)) {
+      state.SkipWithError(ec.message().data());
+      return;
+    }
+    if (const auto ec = acceptors.back().local(endpoint)) {
+      state.SkipWithError(ec.message().data());
+      return;
+    }
+  }
+  std::atomic_int error = 0;
+  const auto fail = [&](const ice::error_code& ec) {
+    auto expected = 0;
+    error.compare_exchange_strong(expected, ec.combined(), std::memory_order_relaxed);
+  };
+  std::atomic_size_t accepted = 0;
+  std::atomic_size_t connected = 0;
+  auto server = [&](std::size_t index) -> ice::sync<void> {
+    co_await ice::schedule(pool[index].context(), true);
+    while (true) {
+      ice::net::tcp::socket socket{ pool[index].service() };
+      if (const auto ec = co_await acceptors[index].accept(socket)) {
+        if (ec != ice::error_code(ECANCELED)) {
+          fail(ec);
+        }
+        break;
+      }
+      const linger value = { 1, 0 };
+      ::setsockopt(socket.handle(), SOL_SOCKET, SO_LINGER, &value, sizeof(value));
+      accepted.fetch_add(1, std::memory_order_relaxed);
+    }
+  };
+  auto client = [&](std::size_t index) -> ice::sync<void> {
+    co_await ice::schedule(pool[index].context(), true);
+    for (std::size_t i = 0; i < batch; i++) {
+      // The reset can arrive before the client observes that the connection was established.
+      ice::net::tcp::socket socket{ pool[index].service() };
+      if (const auto ec = co_await socket.connect(endpoint); ec && ec != ice::error_code(ECONNRESET)) {
+        fail(ec);
+        break;
+      }
+      connected.fetch_add(1, std::memory_order_relaxed);
+      char data = 0;
+      co_await socket.recv(&data, 1);
+    }
+  };
+  auto close = [&](std::size_t index) -> ice::sync<void> {
+    co_await ice::schedule(pool[index].context(), true);
+    acceptors[index].close();
+  };
+  std::vector<ice::sync<void>> servers;
+  for (std::size_t i = 0; i < shards; i++) {
+    servers.push_back(server(i));
+  }
+  std::vector<ice::sync<void>> clients;
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < shards; i++) {
+      clients.push_back(client(i));
+    }
+    for (auto& client : clients) {
+      client.get();
+    }
+    clients.clear();
+    if (error.load(std::memory_order_relaxed)) {
+      break;
+    }
+  }
+  // Connections that were made are in the queue of a listening socket and are accepted unless a server failed.
+  const auto connections = connected.load(std::memory_order_relaxed);
+  while (accepted.load(std::memory_order_relaxed) < connections && !error.load(std::memory_order_relaxed)) {
+    std::this_thread::yield();
+  }
+  for (std::size_t i = 0; i < shards; i++) {
+    close(i).get();
+  }
+  for (auto& server : servers) {
+    server.get();
+  }
+  if (const auto ec = error.load(std::memory_order_relaxed)) {
+    state.SkipWithError(ice::error_code(ec, ice::combined).message().data());
+    return;
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(connections));
+}
+BENCHMARK(net_accept)->DenseRange(1, std::max(std::thread::hardware_concurrency(), 1u), 1)->UseRealTime();
+
+// Sends batches of 64 datagrams of range(0) bytes over loopback and receives them on the same thread, which is pinned
+// to a single core, so the reported packet rate is per core. On Linux, range(1) sends the datagrams of a batch as
+// messages of 16 segments with UDP_SEGMENT and receives them with UDP_GRO, and range(2) selects the service backend.
+static void net_udp(benchmark::State& state) noexcept
+{
+  constexpr std::size_t batch = 64;
+  const auto size = static_cast<std::size_t>(state.range(0));
+  ice::service s0;
+#if ICE_OS_LINUX
+  const auto segments = state.range(1) ? std::size_t(16) : std::size_t(1);
+  const auto backend = static_cast<ice::service::backend_type>(state.range(2));
+  if (const auto ec = s0.create(backend)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  if (s0.backend() != backend) {
+    state.SkipWithError("backend not supported");
+    return;
+  }
+#else
+  const auto segments = std::size_t(1);
+  if (const auto ec = s0.create()) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+#endif
+  ice::net::endpoint endpoint;
+  ice::net::udp::socket server{ s0 };
+  ice::net::udp::socket client{ s0 };
+  if (const auto ec = endpoint.create("127.0.0.1", 0)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  if (const auto ec = server.open(endpoint)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  if (const auto ec = server.local(endpoint)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  if (const auto ec = client.create(endpoint.family(), SOCK_DGRAM, IPPROTO_UDP)) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  server.set(SOL_SOCKET, SO_RCVBUF, 4 * 1024 * 1024);
+#if ICE_OS_LINUX
+  if (segments > 1) {
+    if (const auto ec = server.set(IPPROTO_UDP, UDP_GRO, 1)) {
+      state.SkipWithError(ec.message().data());
+      return;
+    }
+  }
+#endif
+  ice::context c0;
+  auto t0 = std::thread([&]() { s0.run(c0); });
+  if (const auto ec = ice::set_thread_affinity(t0, 0)) {
+    state.SkipWithError(ec.message().data());
+  }
+  auto co = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    std::vector<char> data(batch * size);
+    std::vector<ice::net::udp::message> send(batch / segments);
+    for (std::size_t i = 0; i < send.size(); i++) {
+      send[i] = { data.data() + i * segments * size, segments * size, &endpoint, segments > 1 ? size : 0 };
+    }
+    std::vector<char> buffer(batch * std::max(size, std::size_t(64 * 1024)));
+    std::vector<ice::net::udp::message> recv(batch);
+    const auto capacity = buffer.size() / batch;
+    for (auto _ : state) {
+      if ((co_await client.send(send.data(), send.size())).ec) {
+        state.SkipWithError("send failed");
+        break;
+      }
+      for (std::size_t received = 0; received < batch;) {
+        for (std::size_t i = 0; i < batch; i++) {
+          recv[i] = { buffer.data() + i * capacity, capacity };
+        }
+        const auto result = co_await server.recv(recv.data(), recv.size());
+        if (result.ec) {
+          state.SkipWithError("recv failed");
+          co_return;
+        }
+        for (std::size_t i = 0; i < result.size; i++) {
+          received += recv[i].segment ? (recv[i].size + recv[i].segment - 1) / recv[i].segment : 1;
+        }
+      }
+    }
+    const auto packets = static_cast<double>(state.iterations() * batch);
+    state.counters["packets"] = benchmark::Counter(packets, benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * batch * size));
+  };
+  co().get();
+  s0.stop();
+  t0.join();
+}
+#if ICE_OS_LINUX
+BENCHMARK(net_udp)->ArgsProduct({ { 64, 1200 }, { 0, 1 }, { 0, 1 } })->UseRealTime();
+#else
+BENCHMARK(net_udp)->Arg(64)->Arg(1200)->UseRealTime();
+#endif
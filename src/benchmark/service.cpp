@@ -0,0 +1,43 @@
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <ice/service.hpp>
+#include <ice/utility.hpp>
+#include <benchmark/benchmark.h>
+#include <thread>
+
+// Switches to a context that is attached to a service run loop.
+// Switches to a context on another thread first when range(0) is not zero.
+static void service_context(benchmark::State& state) noexcept
+{
+  const auto hop = state.range(0) != 0;
+  ice::service s0;
+  if (const auto ec = s0.create()) {
+    state.SkipWithError(ec.message().data());
+    return;
+  }
+  ice::context c0;
+  ice::context c1;
+  auto t0 = std::thread([&]() { s0.run(c0); });
+  if (const auto ec = ice::set_thread_affinity(t0, 0)) {
+    state.SkipWithError(ec.message().data());
+  }
+  auto t1 = std::thread([&]() { c1.run(); });
+  if (const auto ec = ice::set_thread_affinity(t1, 1)) {
+    state.SkipWithError(ec.message().data());
+  }
+  auto task = [&]() -> ice::sync<void> {
+    for (auto _ : state) {
+      if (hop) {
+        co_await ice::schedule(c1, true);
+      }
+      co_await ice::schedule(c0, true);
+    }
+    c1.stop();
+    s0.stop();
+  };
+  auto co = task();
+  t0.join();
+  t1.join();
+  co.get();
+}
+BENCHMARK(service_context)->Arg(0)->Arg(1)->UseRealTime();
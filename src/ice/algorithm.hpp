@@ -0,0 +1,169 @@
+#pragma once
+#include <ice/config.hpp>
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <ice/context_pool.hpp>
+#include <ice/when.hpp>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+namespace ice {
+
+// Hands out chunks of an index range to workers. Chunks start large and shrink as the range is consumed, so that
+// workers that finish early pick up the remaining work in small pieces (guided self-scheduling).
+class parallel_range {
+public:
+  parallel_range(std::size_t size, std::size_t workers, std::size_t grain) noexcept :
+    size_(size), divisor_(std::max(workers, std::size_t(1)) * 2), grain_(std::max(grain, std::size_t(1)))
+  {}
+
+  parallel_range(const parallel_range& other) = delete;
+  parallel_range& operator=(const parallel_range& other) = delete;
+
+  // Claims the next chunk. Returns false when the range is exhausted.
+  bool next(std::size_t& begin, std::size_t& end) noexcept
+  {
+    auto index = next_.load(std::memory_order_relaxed);
+    do {
+      if (index >= size_) {
+        return false;
+      }
+      end = std::min(size_, index + std::max(grain_, (size_ - index) / divisor_));
+    } while (!next_.compare_exchange_weak(index, end, std::memory_order_relaxed));
+    begin = index;
+    return true;
+  }
+
+private:
+  const std::size_t size_;
+  const std::size_t divisor_;
+  const std::size_t grain_;
+  alignas(64) std::atomic_size_t next_ = 0;
+};
+
+template <typename Function>
+ice::task<> parallel_worker(ice::context& context, ice::parallel_range& range, Function& function, std::size_t index)
+{
+  co_await ice::schedule(context, true);
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  while (range.next(begin, end)) {
+    function(index, begin, end);
+  }
+}
+
+// Calls function(worker, begin, end) for chunks of the range [0, size) on the contexts of the pool. Chunks are at least
+// grain indices long. The worker index is below the pool size. Workers are started on the contexts in turn regardless
+// of the pool policy. The awaiter is resumed on one of the pool contexts.
+template <typename Function>
+ice::task<> parallel_chunks(ice::context_pool& pool, std::size_t size, std::size_t grain, Function function)
+{
+  grain = std::max(grain, std::size_t(1));
+  const auto workers = std::min(pool.size(), (size + grain - 1) / grain);
+  if (workers == 0) {
+    co_return;
+  }
+  // Coroutine frames are not aligned to cache lines, so the padded range is allocated separately.
+  const auto range = std::make_unique<ice::parallel_range>(size, workers, grain);
+  std::vector<ice::task<>> tasks;
+  tasks.reserve(workers);
+  for (std::size_t i = 0; i < workers; i++) {
+    tasks.push_back(ice::parallel_worker(pool.next(), *range, function, i));
+  }
+  co_await ice::when_all(tasks);
+  for (auto& task : tasks) {
+    task.get();
+  }
+}
+
+// Calls function(element) for each element of the range on the contexts of the pool.
+template <typename Iterator, typename Function>
+ice::task<> parallel_for(
+  ice::context_pool& pool,
+  Iterator first,
+  Iterator last,
+  Function function,
+  std::size_t grain = 1)
+{
+  const auto size = static_cast<std::size_t>(std::distance(first, last));
+  co_await ice::parallel_chunks(pool, size, grain, [&](std::size_t, std::size_t begin, std::size_t end) {
+    const auto chunk = first + static_cast<std::ptrdiff_t>(end);
+    for (auto it = first + static_cast<std::ptrdiff_t>(begin); it != chunk; ++it) {
+      function(*it);
+    }
+  });
+}
+
+// Reduces the transformed elements of the range on the contexts of the pool. The reduction must be associative and
+// commutative.
+template <typename Iterator, typename T, typename Reduce, typename Transform>
+ice::task<T> transform_reduce(
+  ice::context_pool& pool,
+  Iterator first,
+  Iterator last,
+  T init,
+  Reduce reduce,
+  Transform transform,
+  std::size_t grain = 1)
+{
+  struct alignas(64) partial {
+    std::optional<T> value;
+  };
+  std::vector<partial> partials(pool.size());
+  const auto size = static_cast<std::size_t>(std::distance(first, last));
+  co_await ice::parallel_chunks(pool, size, grain, [&](std::size_t worker, std::size_t begin, std::size_t end) {
+    auto& value = partials[worker].value;
+    auto it = first + static_cast<std::ptrdiff_t>(begin);
+    if (!value) {
+      value.emplace(transform(*it++));
+    }
+    for (const auto chunk = first + static_cast<std::ptrdiff_t>(end); it != chunk; ++it) {
+      value = reduce(std::move(*value), transform(*it));
+    }
+  });
+  for (auto& partial : partials) {
+    if (partial.value) {
+      init = reduce(std::move(init), std::move(*partial.value));
+    }
+  }
+  co_return init;
+}
+
+// Sorts the range on the contexts of the pool. Sorts one part per context and merges the parts in parallel rounds.
+template <typename Iterator, typename Compare = std::less<>>
+ice::task<> sort(ice::context_pool& pool, Iterator first, Iterator last, Compare compare = {})
+{
+  constexpr std::size_t cutoff = 4096;
+  const auto size = static_cast<std::size_t>(std::distance(first, last));
+  const auto parts = std::min(pool.size(), size / cutoff);
+  if (parts < 2) {
+    std::sort(first, last, compare);
+    co_return;
+  }
+  const auto bound = [&](std::size_t part) noexcept {
+    return first + static_cast<std::ptrdiff_t>(size * std::min(part, parts) / parts);
+  };
+  co_await ice::parallel_chunks(pool, parts, 1, [&](std::size_t, std::size_t begin, std::size_t end) {
+    for (auto part = begin; part != end; part++) {
+      std::sort(bound(part), bound(part + 1), compare);
+    }
+  });
+  for (std::size_t width = 1; width < parts; width *= 2) {
+    const auto merges = (parts + width * 2 - 1) / (width * 2);
+    co_await ice::parallel_chunks(pool, merges, 1, [&](std::size_t, std::size_t begin, std::size_t end) {
+      for (auto merge = begin; merge != end; merge++) {
+        const auto part = merge * width * 2;
+        std::inplace_merge(bound(part), bound(part + width), bound(part + width * 2), compare);
+      }
+    });
+  }
+}
+
+}  // namespace ice
@@ -1,10 +1,13 @@
 #pragma once
 #include <ice/config.hpp>
-#include <atomic>
-#include <condition_variable>
+#include <ice/frame.hpp>
+#include <ice/futex.hpp>
 #include <experimental/coroutine>
-#include <mutex>
+#include <memory>
 #include <optional>
+#include <type_traits>
+#include <utility>
+#include <cassert>
 
 #if ICE_EXCEPTIONS
 #include <ice/error.hpp>
@@ -13,19 +16,54 @@
 
 namespace ice {
 
-template <typename T>
+// Flag that is set once and that threads can block on. Costs one atomic load when it is already set.
+class completion {
+public:
+  // The waiter can return as soon as the state is ready, so the notification only passes the address to the kernel.
+  void set() noexcept
+  {
+    if (state_.exchange(ready, std::memory_order_acq_rel) == waiting) {
+      state_.notify_all();
+    }
+  }
+
+  void wait() noexcept
+  {
+    auto state = state_.load(std::memory_order_acquire);
+    if (state == ready) {
+      return;
+    }
+    if (state == pending && !state_.compare_exchange_strong(state, waiting, std::memory_order_acq_rel)) {
+      return;
+    }
+    while (state_.load(std::memory_order_acquire) != ready) {
+      state_.wait(waiting);
+    }
+  }
+
+private:
+  enum : ice::futex::value_type {
+    pending,
+    waiting,
+    ready,
+  };
+
+  ice::futex state_{ pending };
+};
+
+// Eagerly started coroutine whose result can be waited for from a thread.
+// The optional allocator is used for the coroutine frame, see ice::frame.
+template <typename T, typename Allocator = void>
 struct sync {
   struct state {
     std::optional<T> value;
-    std::atomic_bool ready = false;
-    std::condition_variable cv;
-    std::mutex mutex;
+    ice::completion ready;
 #if ICE_EXCEPTIONS
     std::exception_ptr exception;
 #endif
   };
 
-  struct promise_type {
+  struct promise_type : ice::frame<Allocator> {
     sync get_return_object() noexcept
     {
       return { this };
@@ -45,8 +83,7 @@ struct sync {
     void return_value(Args&&... args) noexcept(ICE_NO_EXCEPTIONS || std::is_nothrow_constructible_v<T, Args...>)
     {
       state_->value.emplace(std::forward<Args>(args)...);
-      state_->ready.store(true, std::memory_order_release);
-      state_->cv.notify_one();
+      state_->ready.set();
     }
 
 #if ICE_EXCEPTIONS || defined(__clang__)
@@ -54,8 +91,7 @@ struct sync {
     {
 #if ICE_EXCEPTIONS
       state_->exception = std::current_exception();
-      state_->ready.store(true, std::memory_order_release);
-      state_->cv.notify_one();
+      state_->ready.set();
 #endif
     }
 #endif
@@ -70,8 +106,7 @@ struct sync {
 
   T& get() & noexcept(ICE_NO_EXCEPTIONS)
   {
-    std::unique_lock<std::mutex> lock(state_->mutex);
-    state_->cv.wait(lock, [this]() { return state_->ready.load(std::memory_order_acquire); });
+    state_->ready.wait();
 #if ICE_EXCEPTIONS
     if (state_->exception) {
       std::rethrow_exception(state_->exception);
@@ -82,8 +117,7 @@ struct sync {
 
   T&& get() && noexcept(ICE_NO_EXCEPTIONS)
   {
-    std::unique_lock<std::mutex> lock(state_->mutex);
-    state_->cv.wait(lock, [this]() { return state_->ready.load(std::memory_order_acquire); });
+    state_->ready.wait();
 #if ICE_EXCEPTIONS
     if (state_->exception) {
       std::rethrow_exception(state_->exception);
@@ -96,18 +130,16 @@ private:
   std::unique_ptr<state> state_;
 };
 
-template <>
-struct sync<void> {
+template <typename Allocator>
+struct sync<void, Allocator> {
   struct state {
-    std::atomic_bool ready = false;
-    std::condition_variable cv;
-    std::mutex mutex;
+    ice::completion ready;
 #if ICE_EXCEPTIONS
     std::exception_ptr exception;
 #endif
   };
 
-  struct promise_type {
+  struct promise_type : ice::frame<Allocator> {
     sync get_return_object() noexcept
     {
       return { this };
@@ -125,8 +157,7 @@ struct sync<void> {
 
     void return_void() noexcept
     {
-      state_->ready.store(true, std::memory_order_release);
-      state_->cv.notify_one();
+      state_->ready.set();
     }
 
 #if ICE_EXCEPTIONS || defined(__clang__)
@@ -134,8 +165,7 @@ struct sync<void> {
     {
 #if ICE_EXCEPTIONS
       state_->exception = std::current_exception();
-      state_->ready.store(true, std::memory_order_release);
-      state_->cv.notify_one();
+      state_->ready.set();
 #endif
     }
 #endif
@@ -150,8 +180,7 @@ struct sync<void> {
 
   void get() noexcept(ICE_NO_EXCEPTIONS)
   {
-    std::unique_lock<std::mutex> lock(state_->mutex);
-    state_->cv.wait(lock, [this]() { return state_->ready.load(std::memory_order_acquire); });
+    state_->ready.wait();
 #if ICE_EXCEPTIONS
     if (state_->exception) {
       std::rethrow_exception(state_->exception);
@@ -163,9 +192,220 @@ private:
   std::unique_ptr<state> state_;
 };
 
-struct task {
+// Receives the completion of a task that was started with task::start instead of being awaited.
+class join {
+public:
+  // Returns the coroutine to transfer to. The completed task can be destroyed before this function returns.
+  virtual std::experimental::coroutine_handle<> complete() noexcept = 0;
+
+protected:
+  ~join() = default;
+};
+
+// Lazily started coroutine that resumes its awaiter through symmetric transfer when it completes.
+// The optional allocator is used for the coroutine frame, see ice::frame.
+template <typename T = void, typename Allocator = void>
+class task {
+public:
+  class promise_base : public ice::frame<Allocator> {
+  public:
+    struct final_awaiter {
+      constexpr bool await_ready() const noexcept
+      {
+        return false;
+      }
+
+      template <typename Promise>
+      std::experimental::coroutine_handle<> await_suspend(std::experimental::coroutine_handle<Promise> handle) noexcept
+      {
+        auto& promise = handle.promise();
+        return promise.join_ ? promise.join_->complete() : promise.awaiter_;
+      }
+
+      constexpr void await_resume() const noexcept {}
+    };
+
+    constexpr auto initial_suspend() const noexcept
+    {
+      return std::experimental::suspend_always{};
+    }
+
+    constexpr auto final_suspend() const noexcept
+    {
+      return final_awaiter{};
+    }
+
+#if ICE_EXCEPTIONS || defined(__clang__)
+    void unhandled_exception() noexcept
+    {
+#if ICE_EXCEPTIONS
+      exception_ = std::current_exception();
+#endif
+    }
+#endif
+
+  protected:
+    void rethrow() const noexcept(ICE_NO_EXCEPTIONS)
+    {
+#if ICE_EXCEPTIONS
+      if (exception_) {
+        std::rethrow_exception(exception_);
+      }
+#endif
+    }
+
+  private:
+    friend class task;
+    std::experimental::coroutine_handle<> awaiter_ = std::experimental::noop_coroutine();
+    ice::join* join_ = nullptr;
+#if ICE_EXCEPTIONS
+    std::exception_ptr exception_;
+#endif
+  };
+
+  class value_promise final : public promise_base {
+  public:
+    task get_return_object() noexcept
+    {
+      return { handle_type::from_promise(*this) };
+    }
+
+    template <typename... Args>
+    void return_value(Args&&... args) noexcept(ICE_NO_EXCEPTIONS || std::is_nothrow_constructible_v<T, Args...>)
+    {
+      value_.emplace(std::forward<Args>(args)...);
+    }
+
+    T& get() & noexcept(ICE_NO_EXCEPTIONS)
+    {
+      this->rethrow();
+      return *value_;
+    }
+
+    T&& get() && noexcept(ICE_NO_EXCEPTIONS)
+    {
+      this->rethrow();
+      return std::move(*value_);
+    }
+
+  private:
+    std::optional<T> value_;
+  };
+
+  class void_promise final : public promise_base {
+  public:
+    task get_return_object() noexcept
+    {
+      return { handle_type::from_promise(*this) };
+    }
+
+    constexpr void return_void() const noexcept {}
+
+    void get() const noexcept(ICE_NO_EXCEPTIONS)
+    {
+      this->rethrow();
+    }
+  };
+
+  using promise_type = std::conditional_t<std::is_void_v<T>, void_promise, value_promise>;
+  using handle_type = std::experimental::coroutine_handle<promise_type>;
+
+  task(handle_type handle) noexcept : handle_(handle) {}
+
+  task(task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+  task& operator=(task&& other) noexcept
+  {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+
+  task(const task& other) = delete;
+  task& operator=(const task& other) = delete;
+
+  ~task()
+  {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool done() const noexcept
+  {
+    return handle_.done();
+  }
+
+  // Starts the task. The join is notified when the task completes.
+  void start(ice::join& join) noexcept
+  {
+    assert(handle_ && !handle_.done());
+    handle_.promise().join_ = &join;
+    handle_.resume();
+  }
+
+  // Returns the result of a completed task.
+  decltype(auto) get() & noexcept(ICE_NO_EXCEPTIONS)
+  {
+    assert(handle_.done());
+    return handle_.promise().get();
+  }
+
+  decltype(auto) get() && noexcept(ICE_NO_EXCEPTIONS)
+  {
+    assert(handle_.done());
+    return std::move(handle_.promise()).get();
+  }
+
+  auto operator co_await() & noexcept
+  {
+    struct awaitable : awaitable_base {
+      decltype(auto) await_resume() noexcept(ICE_NO_EXCEPTIONS)
+      {
+        return this->handle_.promise().get();
+      }
+    };
+    return awaitable{ { handle_ } };
+  }
+
+  auto operator co_await() && noexcept
+  {
+    struct awaitable : awaitable_base {
+      decltype(auto) await_resume() noexcept(ICE_NO_EXCEPTIONS)
+      {
+        return std::move(this->handle_.promise()).get();
+      }
+    };
+    return awaitable{ { handle_ } };
+  }
+
+private:
+  struct awaitable_base {
+    bool await_ready() const noexcept
+    {
+      return handle_.done();
+    }
+
+    std::experimental::coroutine_handle<> await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+    {
+      handle_.promise().awaiter_ = awaiter;
+      return handle_;
+    }
+
+    handle_type handle_;
+  };
+
+  handle_type handle_;
+};
+
+// Eagerly started coroutine that cannot be awaited.
+struct detached {
   struct promise_type {
-    constexpr task get_return_object() const noexcept
+    constexpr detached get_return_object() const noexcept
     {
       return {};
     }
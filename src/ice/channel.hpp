@@ -0,0 +1,171 @@
+#pragma once
+#include <ice/config.hpp>
+#include <ice/mutex.hpp>
+#include <atomic>
+#include <experimental/coroutine>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+#include <cstddef>
+
+namespace ice {
+
+// Bounded multi-producer multi-consumer queue of values that are moved between coroutines. Senders are suspended when
+// the channel is full and receivers when it is empty. They are resumed on the context they were suspended on.
+//
+// co_await channel.send(std::move(value));
+// auto value = co_await channel.receive();
+template <typename T>
+class channel {
+public:
+  static_assert(std::is_nothrow_move_constructible_v<T>);
+
+  // The value must stay alive until the awaitable is resumed.
+  class send_awaitable : public ice::async_semaphore::acquire_awaitable {
+  public:
+    send_awaitable(channel& channel, T& value) noexcept :
+      acquire_awaitable(channel.free_), channel_(channel), value_(value)
+    {}
+
+    void await_resume() noexcept
+    {
+      channel_.push(value_);
+    }
+
+  private:
+    channel& channel_;
+    T& value_;
+  };
+
+  class receive_awaitable : public ice::async_semaphore::acquire_awaitable {
+  public:
+    receive_awaitable(channel& channel) noexcept : acquire_awaitable(channel.used_), channel_(channel) {}
+
+    T await_resume() noexcept
+    {
+      return channel_.pop();
+    }
+
+  private:
+    channel& channel_;
+  };
+
+  explicit channel(std::size_t capacity) noexcept(ICE_NO_EXCEPTIONS) :
+    free_(static_cast<std::int64_t>(capacity)), size_(ring(capacity)), slots_(std::make_unique<slot[]>(size_))
+  {
+    assert(capacity > 0);
+    for (std::size_t i = 0; i < size_; i++) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  channel(const channel& other) = delete;
+  channel& operator=(const channel& other) = delete;
+
+  // Sends a value and suspends the awaiter while the channel is full.
+  send_awaitable send(T&& value) noexcept
+  {
+    return { *this, value };
+  }
+
+  // Receives a value and suspends the awaiter while the channel is empty.
+  receive_awaitable receive() noexcept
+  {
+    return { *this };
+  }
+
+  // Moves the value into the channel unless it is full.
+  bool try_send(T& value) noexcept
+  {
+    if (!free_.try_acquire()) {
+      return false;
+    }
+    push(value);
+    return true;
+  }
+
+  bool try_send(T&& value) noexcept
+  {
+    return try_send(value);
+  }
+
+  std::optional<T> try_receive() noexcept
+  {
+    if (!used_.try_acquire()) {
+      return std::nullopt;
+    }
+    return pop();
+  }
+
+private:
+  struct slot {
+    std::atomic_size_t sequence = 0;
+    std::optional<T> value;
+  };
+
+  static constexpr std::size_t ring(std::size_t capacity) noexcept
+  {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size *= 2;
+    }
+    return size;
+  }
+
+  // Stores a value in the next slot after a unit was acquired from free_. The slot is claimed with a single atomic
+  // increment. It is always empty because units of free_ are released in slot order.
+  void push(T& value) noexcept
+  {
+    const auto position = tail_.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = slots_[position & (size_ - 1)];
+    assert(slot.sequence.load(std::memory_order_acquire) == position);
+    slot.value.emplace(std::move(value));
+    slot.sequence.store(position + 1, std::memory_order_seq_cst);
+    release(sent_, 1, used_);
+  }
+
+  // Takes a value from the next slot after a unit was acquired from used_. The slot always holds a value because units
+  // of used_ are released in slot order.
+  T pop() noexcept
+  {
+    const auto position = head_.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = slots_[position & (size_ - 1)];
+    assert(slot.sequence.load(std::memory_order_acquire) == position + 1);
+    T value{ std::move(*slot.value) };
+    slot.value.reset();
+    slot.sequence.store(position + size_, std::memory_order_seq_cst);
+    release(received_, size_, free_);
+    return value;
+  }
+
+  // Advances the position up to which operations completed in order and releases a unit for every slot it passes.
+  // Operations that complete out of order leave their units to the operation that completes the gap, so that a unit
+  // never refers to a slot that is still in use and nobody has to wait for another operation to finish.
+  void release(std::atomic_size_t& completed, std::size_t offset, ice::async_semaphore& semaphore) noexcept
+  {
+    std::size_t count = 0;
+    auto position = completed.load(std::memory_order_seq_cst);
+    while (slots_[position & (size_ - 1)].sequence.load(std::memory_order_seq_cst) == position + offset) {
+      if (completed.compare_exchange_weak(position, position + 1, std::memory_order_seq_cst)) {
+        position++;
+        count++;
+      }
+    }
+    if (count) {
+      semaphore.release(count);
+    }
+  }
+
+  ice::async_semaphore free_;
+  ice::async_semaphore used_;
+  const std::size_t size_;
+  const std::unique_ptr<slot[]> slots_;
+  alignas(64) std::atomic_size_t tail_ = 0;
+  alignas(64) std::atomic_size_t head_ = 0;
+  alignas(64) std::atomic_size_t sent_ = 0;
+  alignas(64) std::atomic_size_t received_ = 0;
+};
+
+}  // namespace ice
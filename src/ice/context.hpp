@@ -1,13 +1,27 @@
 #pragma once
 #include <ice/config.hpp>
+#include <ice/futex.hpp>
 #include <ice/utility.hpp>
+#include <algorithm>
 #include <atomic>
-#include <condition_variable>
+#include <bit>
+#include <chrono>
 #include <experimental/coroutine>
+#include <memory>
 #include <mutex>
+#include <type_traits>
+#include <cassert>
+#include <cstdint>
+#include <immintrin.h>
 
 namespace ice {
 
+enum class priority : std::uint8_t {
+  high,
+  normal,
+  low,
+};
+
 class context {
 public:
   class event {
@@ -37,86 +51,1092 @@ public:
   private:
     friend class context;
     std::atomic<event*> next_ = nullptr;
+    std::int64_t scheduled_ = 0;
+  };
+
+  class timer : public event {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    timer(context& context, clock::time_point deadline) noexcept : context_(context), deadline_(deadline) {}
+
+    bool await_ready() const noexcept
+    {
+      return deadline_ <= clock::now();
+    }
+
+    bool await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+    {
+      awaiter_ = awaiter;
+      return context_.start(this);
+    }
+
+    // Returns false if the timer was cancelled.
+    bool await_resume() const noexcept
+    {
+      return state_ != state::cancelled;
+    }
+
+    // Resumes the awaiting coroutine before the deadline. Returns false if the timer already expired.
+    bool cancel() noexcept
+    {
+      return context_.cancel(this);
+    }
+
+  private:
+    friend class context;
+
+    enum class state : std::uint8_t {
+      idle,
+      pending,
+      expired,
+      cancelled,
+    };
+
+    context& context_;
+    const clock::time_point deadline_;
+    std::uint64_t tick_ = 0;
+    timer* prev_timer_ = nullptr;
+    timer* next_timer_ = nullptr;
+    std::uint8_t level_ = 0;
+    std::uint8_t slot_ = 0;
+    state state_ = state::idle;
+  };
+
+  // Snapshot of the counters of all threads that run the context.
+  struct statistics {
+    std::uint64_t resumed = 0;  // events resumed
+    std::uint64_t parks = 0;    // times a thread blocked because it ran out of work
+    std::uint64_t batch = 0;    // largest number of events resumed between two parks of a thread
+    std::uint64_t yields = 0;   // coroutines moved to the back of the queue because their budget was exhausted
+    std::chrono::nanoseconds parked{};
+    std::chrono::nanoseconds running{};
+
+    // Schedule to resume latency of every 64th scheduled event. Bucket i counts latencies below 2^i nanoseconds.
+    std::uint64_t latency[32] = {};
+  };
+
+private:
+  // Intrusive multi-producer single-consumer FIFO queue with wait-free producers (Dmitry Vyukov).
+  class queue {
+  public:
+    queue() noexcept : head_(&stub_), tail_(&stub_) {}
+
+    // Appends a linked list of events.
+    void push(event* first, event* last) noexcept
+    {
+      last->next_.store(nullptr, std::memory_order_relaxed);
+      const auto prev = head_.exchange(last, std::memory_order_acq_rel);
+      prev->next_.store(first, std::memory_order_release);
+    }
+
+    // Removes the oldest event. Returns nullptr when empty or when a producer has not finished linking yet.
+    event* pop() noexcept
+    {
+      auto tail = tail_.load(std::memory_order_relaxed);
+      auto next = tail->next_.load(std::memory_order_acquire);
+      if (tail == &stub_) {
+        if (!next) {
+          return nullptr;
+        }
+        tail_.store(next, std::memory_order_relaxed);
+        tail = next;
+        next = next->next_.load(std::memory_order_acquire);
+      }
+      if (next) {
+        tail_.store(next, std::memory_order_relaxed);
+        return tail;
+      }
+      if (tail != head_.load(std::memory_order_acquire)) {
+        return nullptr;
+      }
+      push(&stub_, &stub_);
+      next = tail->next_.load(std::memory_order_acquire);
+      if (next) {
+        tail_.store(next, std::memory_order_relaxed);
+        return tail;
+      }
+      return nullptr;
+    }
+
+    // Returns true if the queue is empty. Can be called from any thread.
+    bool empty() const noexcept
+    {
+      return tail_.load(std::memory_order_relaxed) == &stub_ && !stub_.next_.load(std::memory_order_acquire);
+    }
+
+  private:
+    alignas(64) std::atomic<event*> head_;
+    alignas(64) std::atomic<event*> tail_;
+    event stub_;
+  };
+
+  // Shared queue for one priority.
+  struct lane {
+    queue events;
+    alignas(64) std::atomic_size_t size = 0;
+    std::atomic_flag consumer;
+  };
+
+  // Bounded FIFO ring that is pushed to and popped from by the owning worker and stolen from by the others.
+  class deque {
+  public:
+    constexpr static std::uint32_t capacity = 256;
+
+    bool push(event* ev) noexcept
+    {
+      const auto tail = tail_.load(std::memory_order_relaxed);
+      if (tail - head_.load(std::memory_order_acquire) >= capacity) {
+        return false;
+      }
+      slots_[tail % capacity].store(ev, std::memory_order_relaxed);
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Appends events until the deque is full. Returns the first event that was not appended.
+    template <typename Iterator>
+    Iterator push(Iterator first, Iterator last) noexcept
+    {
+      const auto tail = tail_.load(std::memory_order_relaxed);
+      auto size = tail;
+      for (const auto head = head_.load(std::memory_order_acquire); first != last && size - head < capacity; ++first) {
+        slots_[size++ % capacity].store(*first, std::memory_order_relaxed);
+      }
+      if (size != tail) {
+        tail_.store(size, std::memory_order_release);
+      }
+      return first;
+    }
+
+    // Returns the number of events that can be pushed without failing.
+    std::uint32_t space() const noexcept
+    {
+      return capacity - (tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_acquire));
+    }
+
+    std::uint32_t size() const noexcept
+    {
+      const auto head = head_.load(std::memory_order_acquire);
+      const auto size = tail_.load(std::memory_order_acquire) - head;
+      return size <= capacity ? size : 0;
+    }
+
+    event* pop() noexcept
+    {
+      auto head = head_.load(std::memory_order_acquire);
+      while (head != tail_.load(std::memory_order_relaxed)) {
+        const auto ev = slots_[head % capacity].load(std::memory_order_relaxed);
+        if (head_.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+          return ev;
+        }
+      }
+      return nullptr;
+    }
+
+    // Moves half of the events to the empty deque of the calling worker and returns one of them.
+    event* steal(deque& dst) noexcept
+    {
+      const auto dst_tail = dst.tail_.load(std::memory_order_relaxed);
+      auto head = head_.load(std::memory_order_acquire);
+      while (true) {
+        const auto size = tail_.load(std::memory_order_acquire) - head;
+        if (size == 0) {
+          return nullptr;
+        }
+        if (size > capacity) {
+          head = head_.load(std::memory_order_acquire);
+          continue;
+        }
+        const auto count = size - size / 2;
+        for (std::uint32_t i = 0; i < count; i++) {
+          const auto ev = slots_[(head + i) % capacity].load(std::memory_order_relaxed);
+          dst.slots_[(dst_tail + i) % capacity].store(ev, std::memory_order_relaxed);
+        }
+        if (head_.compare_exchange_weak(head, head + count, std::memory_order_acq_rel, std::memory_order_acquire)) {
+          const auto ev = dst.slots_[(dst_tail + count - 1) % capacity].load(std::memory_order_relaxed);
+          dst.tail_.store(dst_tail + count - 1, std::memory_order_release);
+          return ev;
+        }
+      }
+    }
+
+  private:
+    alignas(64) std::atomic<std::uint32_t> head_ = 0;
+    alignas(64) std::atomic<std::uint32_t> tail_ = 0;
+    std::atomic<event*> slots_[capacity] = {};
+  };
+
+  // Hierarchical timing wheel with 64 slots per level and a resolution of one tick.
+  // Timers are inserted and removed in constant time and cascade to lower levels as time advances.
+  class wheel {
+  public:
+    constexpr static std::uint64_t never = UINT64_MAX;
+    constexpr static std::size_t levels = 11;
+
+    // Inserts the timer. Returns false if its tick already passed.
+    bool insert(timer* t) noexcept
+    {
+      if (t->tick_ <= now_) {
+        return false;
+      }
+      link(t);
+      return true;
+    }
+
+    void remove(timer* t) noexcept
+    {
+      if (t->prev_timer_) {
+        t->prev_timer_->next_timer_ = t->next_timer_;
+      } else {
+        slots_[t->level_][t->slot_] = t->next_timer_;
+        if (!t->next_timer_) {
+          occupied_[t->level_] &= ~(std::uint64_t(1) << t->slot_);
+        }
+      }
+      if (t->next_timer_) {
+        t->next_timer_->prev_timer_ = t->prev_timer_;
+      }
+    }
+
+    // Returns the tick at which the earliest non-empty slot must be processed.
+    std::uint64_t next() const noexcept
+    {
+      for (std::size_t level = 0; level < levels; level++) {
+        const auto shift = 6 * level;
+        const auto bits = occupied_[level] & (~std::uint64_t(0) << ((now_ >> shift) & 63));
+        if (bits) {
+          const auto start = shift + 6 < 64 ? now_ & ~((std::uint64_t(1) << (shift + 6)) - 1) : 0;
+          return start + (static_cast<std::uint64_t>(std::countr_zero(bits)) << shift);
+        }
+      }
+      return never;
+    }
+
+    // Advances the wheel to the given tick and calls the handler for every expired timer.
+    template <typename Handler>
+    void advance(std::uint64_t now, Handler&& handler) noexcept
+    {
+      for (auto tick = next(); tick <= now; tick = next()) {
+        now_ = std::max(now_, tick);
+        for (std::size_t level = 0; level < levels; level++) {
+          const auto slot = (tick >> (6 * level)) & 63;
+          if (!(occupied_[level] & (std::uint64_t(1) << slot))) {
+            continue;
+          }
+          auto t = std::exchange(slots_[level][slot], nullptr);
+          occupied_[level] &= ~(std::uint64_t(1) << slot);
+          while (t) {
+            const auto next = t->next_timer_;
+            if (t->tick_ <= now_) {
+              handler(t);
+            } else {
+              link(t);
+            }
+            t = next;
+          }
+          break;
+        }
+      }
+      now_ = std::max(now_, now);
+    }
+
+  private:
+    void link(timer* t) noexcept
+    {
+      const auto level = static_cast<std::size_t>(std::bit_width((t->tick_ ^ now_) | 63) - 1) / 6;
+      const auto slot = static_cast<std::size_t>((t->tick_ >> (6 * level)) & 63);
+      t->level_ = static_cast<std::uint8_t>(level);
+      t->slot_ = static_cast<std::uint8_t>(slot);
+      t->prev_timer_ = nullptr;
+      t->next_timer_ = slots_[level][slot];
+      if (t->next_timer_) {
+        t->next_timer_->prev_timer_ = t;
+      }
+      slots_[level][slot] = t;
+      occupied_[level] |= std::uint64_t(1) << slot;
+    }
+
+    std::uint64_t now_ = 0;
+    std::uint64_t occupied_[levels] = {};
+    timer* slots_[levels][64] = {};
   };
 
-  context() = default;
+  // Written by the worker thread only. Atomic so that statistics() can read them from other threads.
+  struct counters {
+    std::atomic_uint64_t resumed = 0;
+    std::atomic_uint64_t parks = 0;
+    std::atomic_uint64_t batch = 0;
+    std::atomic_uint64_t yields = 0;
+    std::atomic_int64_t parked = 0;
+    std::atomic_int64_t running = 0;
+    std::atomic_uint64_t latency[32] = {};
+  };
+
+  struct alignas(64) worker {
+    deque local;
+    context* owner = nullptr;
+    std::uint32_t tick = 0;
+    std::uint32_t seed = 0;
+    std::uint32_t transfers = 0;
+    std::uint32_t budget = 0;
+    std::uint64_t batch = 0;
+    timer::clock::time_point since;
+    std::atomic_bool attached = false;
+    alignas(64) counters stats;
+  };
+
+  // Every sample_rate-th scheduled event is timestamped for the latency histogram.
+  constexpr static std::uint32_t sample_rate = 64;
+
+  // Limits how many events are resumed through symmetric transfer before control returns to the run loop.
+  constexpr static std::uint32_t transfer_limit = 64;
+
+public:
+  // The spin parameter sets how many times an idle thread polls for events before it blocks.
+  // The budget parameter sets how many schedule awaits on this context can complete without suspending after an event
+  // is resumed before the coroutine is moved to the back of the queue. Other awaitables that complete without
+  // suspending are not charged. A budget of zero is unlimited.
+  explicit context(std::size_t concurrency = 1, std::size_t spin = 0, std::uint32_t budget = 256) noexcept :
+    workers_(std::make_unique<worker[]>(concurrency)), size_(concurrency), spin_(spin), budget_(budget)
+  {
+    assert(concurrency > 0);
+    for (std::size_t i = 0; i < size_; i++) {
+      workers_[i].owner = this;
+      workers_[i].seed = static_cast<std::uint32_t>(i * 0x9E3779B9 + 1);
+    }
+  }
 
   context(const context& other) = delete;
   context& operator=(const context& other) = delete;
 
+  // Runs the scheduler on the calling thread until the context is stopped and out of work.
+  // Up to the concurrency passed to the constructor threads can call this function simultaneously. Additional threads
+  // return immediately.
   void run() noexcept
   {
-    const auto index = index_.set(this);
-    std::unique_lock<std::mutex> lock{ mutex_ };
-    lock.unlock();
+    const auto claimed = attach();
+    if (!claimed) {
+      return;
+    }
+    auto& self = *claimed;
+    const auto index = index_.set(&self);
     while (true) {
-      lock.lock();
-      auto head = head_.exchange(nullptr, std::memory_order_acquire);
-      while (!head) {
-        if (stop_.load(std::memory_order_acquire)) {
-          lock.unlock();
-          return;
-        }
-        cv_.wait(lock, []() { return true; });
-        head = head_.exchange(nullptr, std::memory_order_acquire);
+      if (const auto ev = next(self)) {
+        resume(self, ev);
+        continue;
       }
-      lock.unlock();
-      while (head) {
-        auto next = head->next_.load(std::memory_order_relaxed);
-        head->resume();
-        head = next;
+      if (const auto ev = park(self)) {
+        resume(self, ev);
+        continue;
       }
+      ran(self);
+      detach(self);
+      return;
     }
   }
 
+  // Runs the context on the calling thread from an external event loop like ice::service::run.
+  // The wake function is called when an event is scheduled or the context is stopped while the loop is blocked.
+  class loop {
+  public:
+    using wake_type = void (*)(void* data) noexcept;
+
+    loop(context& context, wake_type wake, void* data) noexcept :
+      context_(context), self_(context.attach()), index_(context.index_.set(self_)), wake_(wake), data_(data)
+    {
+      if (self_) {
+        context_.loop_.store(this, std::memory_order_release);
+      }
+    }
+
+    loop(const loop& other) = delete;
+    loop& operator=(const loop& other) = delete;
+
+    ~loop()
+    {
+      if (!self_) {
+        return;
+      }
+      if (blocked_.load(std::memory_order_relaxed)) {
+        context_.unparked(*self_);
+        context_.sleepers_.fetch_sub(1, std::memory_order_relaxed);
+      } else {
+        context_.ran(*self_);
+      }
+      context_.loop_.store(nullptr, std::memory_order_release);
+      context_.detach(*self_);
+    }
+
+    // Returns false if all workers of the context are in use, in which case the loop must not be polled.
+    explicit operator bool() const noexcept
+    {
+      return self_ != nullptr;
+    }
+
+    // Resumes up to limit ready events. Sets the timeout to zero when more events are ready, to the time until the
+    // next timer expires or to nanoseconds::max() when the external loop can block until it is woken up.
+    // Returns false when the context is stopped and out of work.
+    bool poll(std::chrono::nanoseconds& timeout, std::size_t limit = deque::capacity) noexcept
+    {
+      if (blocked_.load(std::memory_order_relaxed)) {
+        context_.unparked(*self_);
+        context_.sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        blocked_.store(false, std::memory_order_relaxed);
+        context_.expire();
+      }
+      for (std::size_t i = 0; i < limit; i++) {
+        if (const auto ev = context_.next(*self_)) {
+          context_.resume(*self_, ev);
+          continue;
+        }
+        // Marked as blocked before registering as a sleeper so that notify() wakes up the external loop.
+        blocked_.store(true, std::memory_order_seq_cst);
+        context_.sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (const auto ev = context_.next(*self_)) {
+          context_.sleepers_.fetch_sub(1, std::memory_order_relaxed);
+          blocked_.store(false, std::memory_order_relaxed);
+          context_.resume(*self_, ev);
+          continue;
+        }
+        if (context_.stop_.load(std::memory_order_seq_cst)) {
+          context_.sleepers_.fetch_sub(1, std::memory_order_relaxed);
+          blocked_.store(false, std::memory_order_relaxed);
+          return false;
+        }
+        context_.parking(*self_);
+        timeout = std::chrono::nanoseconds::max();
+        if (const auto deadline = context_.deadline_.load(std::memory_order_acquire); deadline != wheel::never) {
+          const auto time = context_.start_ + std::chrono::microseconds(deadline) - timer::clock::now();
+          timeout = std::max(std::chrono::duration_cast<std::chrono::nanoseconds>(time), timeout.zero());
+        }
+        return true;
+      }
+      timeout = timeout.zero();
+      return true;
+    }
+
+  private:
+    friend class context;
+    context& context_;
+    worker* const self_;
+    ice::thread_local_storage<worker>::lock index_;
+    const wake_type wake_;
+    void* const data_;
+    std::atomic_bool blocked_ = false;
+  };
+
   bool is_current() const noexcept
   {
-    return index_.get() ? true : false;
+    const auto self = index_.get();
+    return self && self->owner == this;
+  }
+
+  // Returns true if the calling thread runs this context and a schedule await can complete without suspending. Each
+  // such await is charged to the budget of the resumed event. Returns false when the budget is spent so that the
+  // awaiter is moved to the back of the queue.
+  bool is_resumable() noexcept
+  {
+    const auto self = index_.get();
+    if (!self || self->owner != this) {
+      return false;
+    }
+    if (!budget_) {
+      return true;
+    }
+    if (self->budget) {
+      self->budget--;
+      return true;
+    }
+    add(self->stats.yields, std::uint64_t(1));
+    return false;
+  }
+
+  // Returns the context that runs on the calling thread or nullptr.
+  static context* current() noexcept
+  {
+    const auto self = index_.get();
+    return self ? self->owner : nullptr;
+  }
+
+  // Returns the approximate number of events that are ready to be resumed.
+  std::size_t load() const noexcept
+  {
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < size_; i++) {
+      size += workers_[i].local.size();
+    }
+    for (const auto& lane : lanes_) {
+      size += lane.size.load(std::memory_order_relaxed);
+    }
+    return size;
+  }
+
+  // Sums the counters of all workers. Can be called from any thread.
+  statistics stats() const noexcept
+  {
+    statistics stats;
+    for (std::size_t i = 0; i < size_; i++) {
+      const auto& counters = workers_[i].stats;
+      stats.resumed += counters.resumed.load(std::memory_order_relaxed);
+      stats.parks += counters.parks.load(std::memory_order_relaxed);
+      stats.batch = std::max(stats.batch, counters.batch.load(std::memory_order_relaxed));
+      stats.yields += counters.yields.load(std::memory_order_relaxed);
+      stats.parked += std::chrono::nanoseconds(counters.parked.load(std::memory_order_relaxed));
+      stats.running += std::chrono::nanoseconds(counters.running.load(std::memory_order_relaxed));
+      for (std::size_t j = 0; j < 32; j++) {
+        stats.latency[j] += counters.latency[j].load(std::memory_order_relaxed);
+      }
+    }
+    return stats;
   }
 
   void stop() noexcept
   {
-    stop_.store(true, std::memory_order_release);
-    cv_.notify_all();
+    stop_.store(true, std::memory_order_seq_cst);
+    epoch_.fetch_add(1, std::memory_order_release);
+    epoch_.notify_all();
+    if (const auto loop = loop_.load(std::memory_order_acquire)) {
+      loop->wake_(loop->data_);
+    }
   }
 
-  void schedule(event* ev) noexcept
+  // Inserts the timer. Returns false if the deadline already passed or the timer was cancelled.
+  bool start(timer* t) noexcept
   {
-    auto head = head_.load(std::memory_order_acquire);
-    do {
-      ev->next_.store(head, std::memory_order_relaxed);
-    } while (!head_.compare_exchange_weak(head, ev, std::memory_order_release, std::memory_order_acquire));
-    cv_.notify_one();
+    t->tick_ = tick(t->deadline_);
+    std::unique_lock<std::mutex> lock{ wheel_mutex_ };
+    if (t->state_ == timer::state::cancelled || !wheel_.insert(t)) {
+      return false;
+    }
+    t->state_ = timer::state::pending;
+    if (t->tick_ < deadline_.load(std::memory_order_relaxed)) {
+      deadline_.store(wheel_.next(), std::memory_order_release);
+      lock.unlock();
+      notify();
+    }
+    return true;
+  }
+
+  // Removes the timer and schedules it. Returns false if the timer already expired.
+  bool cancel(timer* t) noexcept
+  {
+    std::unique_lock<std::mutex> lock{ wheel_mutex_ };
+    switch (t->state_) {
+    case timer::state::idle: t->state_ = timer::state::cancelled; return true;
+    case timer::state::pending: break;
+    default: return false;
+    }
+    wheel_.remove(t);
+    t->state_ = timer::state::cancelled;
+    deadline_.store(wheel_.next(), std::memory_order_release);
+    lock.unlock();
+    schedule(t);
+    return true;
+  }
+
+  void schedule(event* ev, ice::priority priority = ice::priority::normal) noexcept
+  {
+    sample(ev);
+    if (priority == ice::priority::normal) {
+      if (const auto self = index_.get(); self && self->owner == this && self->local.push(ev)) {
+        if (size_ > 1) {
+          notify();
+        }
+        return;
+      }
+    }
+    auto& lane = lanes_[static_cast<std::size_t>(priority)];
+    lane.size.fetch_add(1, std::memory_order_relaxed);
+    lane.events.push(ev, ev);
+    notify();
+  }
+
+  // Schedules a range of event pointers in order. The events are linked locally and published with one exchange on the
+  // shared queue followed by at most one wakeup.
+  template <typename Iterator>
+  void schedule(Iterator first, Iterator last, ice::priority priority = ice::priority::normal) noexcept
+  {
+    if (first == last) {
+      return;
+    }
+    for (auto it = first; it != last; ++it) {
+      sample(*it);
+    }
+    if (priority == ice::priority::normal) {
+      if (const auto self = index_.get(); self && self->owner == this) {
+        first = self->local.push(first, last);
+        if (first == last) {
+          if (size_ > 1) {
+            notify();
+          }
+          return;
+        }
+      }
+    }
+    event* head = *first;
+    event* tail = head;
+    std::size_t count = 1;
+    for (++first; first != last; ++first) {
+      tail->next_.store(*first, std::memory_order_relaxed);
+      tail = *first;
+      count++;
+    }
+    auto& lane = lanes_[static_cast<std::size_t>(priority)];
+    lane.size.fetch_add(count, std::memory_order_relaxed);
+    lane.events.push(head, tail);
+    notify();
+  }
+
+
+  // Returns the next event of the context that runs on the calling thread so that an awaiter can resume it directly
+  // instead of returning to the run loop. Returns a no-op handle when the thread does not run a context, when it is out
+  // of work or when too many events were resumed this way in a row.
+  static std::experimental::coroutine_handle<> transfer() noexcept
+  {
+    if (const auto self = index_.get(); self && self->transfers < transfer_limit) {
+      if (const auto ev = self->owner->next(*self)) {
+        self->transfers++;
+        self->budget = self->owner->budget_;
+        self->owner->resumed(*self, ev);
+        return ev->awaiter_;
+      }
+    }
+    return std::experimental::noop_coroutine();
   }
 
 private:
+  void resume(worker& self, event* ev) noexcept
+  {
+    self.transfers = 0;
+    self.budget = budget_;
+    resumed(self, ev);
+    ev->resume();
+  }
+
+  // Returns the next event. Lanes are drained in weighted priority order: when all lanes have events, 12 out of 16
+  // are taken from the high, 3 from the normal and 1 from the low priority lane, so that no lane can starve.
+  // Events with normal priority are taken from the local deque, which is refilled from the shared queue periodically.
+  event* next(worker& self) noexcept
+  {
+    const auto tick = ++self.tick;
+    if (tick % 61 == 0) {
+      expire();
+      acquire(self);
+    }
+    if (tick % 16 == 0) {
+      if (const auto ev = pop(ice::priority::low)) {
+        return ev;
+      }
+    }
+    if (tick % 4 != 0) {
+      if (const auto ev = pop(ice::priority::high)) {
+        return ev;
+      }
+    }
+    if (const auto ev = self.local.pop()) {
+      return ev;
+    }
+    if (acquire(self)) {
+      if (const auto ev = self.local.pop()) {
+        return ev;
+      }
+    }
+    if (const auto ev = pop(ice::priority::high)) {
+      return ev;
+    }
+    if (const auto ev = pop(ice::priority::low)) {
+      return ev;
+    }
+    return steal(self);
+  }
+
+  // Removes the oldest event from a shared high or low priority lane.
+  event* pop(ice::priority priority) noexcept
+  {
+    auto& lane = lanes_[static_cast<std::size_t>(priority)];
+    if (lane.events.empty() || lane.consumer.test_and_set(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    const auto ev = lane.events.pop();
+    lane.consumer.clear(std::memory_order_release);
+    if (ev) {
+      lane.size.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return ev;
+  }
+
+  // Moves events from the shared normal priority lane to the back of the local deque in arrival order.
+  bool acquire(worker& self) noexcept
+  {
+    auto& lane = lanes_[static_cast<std::size_t>(ice::priority::normal)];
+    if (lane.events.empty() || lane.consumer.test_and_set(std::memory_order_acquire)) {
+      return false;
+    }
+    const auto count = std::min(self.local.space(), deque::capacity / 2);
+    std::uint32_t i = 0;
+    for (; i < count; i++) {
+      const auto ev = lane.events.pop();
+      if (!ev) {
+        break;
+      }
+      self.local.push(ev);
+    }
+    lane.consumer.clear(std::memory_order_release);
+    lane.size.fetch_sub(i, std::memory_order_relaxed);
+    if (size_ > 1 && i > 1) {
+      notify();
+    }
+    return i > 0;
+  }
+
+  // Polls for events and then blocks until one is available. Returns nullptr when the context is stopped.
+  // Only one blocked thread waits for the next timer deadline, the others wait until they are notified. A thread that
+  // finds an earlier deadline than the watched one takes over, and a watcher that leaves with work wakes a successor.
+  event* park(worker& self) noexcept
+  {
+    for (std::size_t i = 0; i < spin_; i++) {
+      _mm_pause();
+      if (const auto ev = next(self)) {
+        return ev;
+      }
+    }
+    auto watcher = false;
+    while (true) {
+      const auto epoch = epoch_.load(std::memory_order_acquire);
+      sleepers_.fetch_add(1, std::memory_order_seq_cst);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (const auto ev = next(self)) {
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        if (watcher && deadline_.load(std::memory_order_acquire) != wheel::never) {
+          notify();
+        }
+        return ev;
+      }
+      if (stop_.load(std::memory_order_seq_cst)) {
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      parking(self);
+      auto deadline = deadline_.load(std::memory_order_acquire);
+      auto watched = watched_.load(std::memory_order_relaxed);
+      watcher = deadline < watched && watched_.compare_exchange_strong(watched, deadline, std::memory_order_relaxed);
+      if (watcher) {
+        epoch_.wait(epoch, start_ + std::chrono::microseconds(deadline) - timer::clock::now());
+        watched_.compare_exchange_strong(deadline, wheel::never, std::memory_order_relaxed);
+      } else {
+        epoch_.wait(epoch);
+      }
+      unparked(self);
+      sleepers_.fetch_sub(1, std::memory_order_relaxed);
+      expire();
+    }
+  }
+
+  // Schedules expired timers.
+  void expire() noexcept
+  {
+    if (deadline_.load(std::memory_order_acquire) == wheel::never) {
+      return;
+    }
+    const auto now = std::chrono::duration_cast<std::chrono::microseconds>(timer::clock::now() - start_);
+    if (static_cast<std::uint64_t>(now.count()) < deadline_.load(std::memory_order_acquire)) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock{ wheel_mutex_, std::try_to_lock };
+    if (!lock) {
+      return;
+    }
+    wheel_.advance(static_cast<std::uint64_t>(now.count()), [this](timer* t) {
+      t->state_ = timer::state::expired;
+      schedule(t);
+    });
+    deadline_.store(wheel_.next(), std::memory_order_release);
+  }
+
+  // Converts a time point to wheel ticks rounded up to the next microsecond.
+  std::uint64_t tick(timer::clock::time_point tp) const noexcept
+  {
+    const auto us = std::chrono::ceil<std::chrono::microseconds>(tp - start_).count();
+    return us > 0 ? static_cast<std::uint64_t>(us) : 0;
+  }
+
+  // Wakes up a blocked thread. Costs a fence and a load when no thread is blocked.
+  void notify() noexcept
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed)) {
+      const auto loop = loop_.load(std::memory_order_acquire);
+      if (loop && loop->blocked_.load(std::memory_order_seq_cst)) {
+        loop->wake_(loop->data_);
+        return;
+      }
+      epoch_.fetch_add(1, std::memory_order_release);
+      epoch_.notify_one();
+    }
+  }
+
+  // Claims a free worker for the calling thread. Returns nullptr when all workers are in use.
+  worker* attach() noexcept
+  {
+    for (std::size_t i = 0; i < size_; i++) {
+      auto& self = workers_[i];
+      if (!self.attached.exchange(true, std::memory_order_acquire)) {
+        self.since = timer::clock::now();
+        return &self;
+      }
+    }
+    return nullptr;
+  }
+
+  // Releases the worker so that another thread can run the context with it.
+  void detach(worker& self) noexcept
+  {
+    self.attached.store(false, std::memory_order_release);
+  }
+
+  // Adds to a counter that is only written by the calling thread without a locked instruction.
+  template <typename T>
+  static void add(std::atomic<T>& counter, T value) noexcept
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  // Timestamps every sample_rate-th event scheduled by the calling thread.
+  static void sample(event* ev) noexcept
+  {
+    if (++sample_ % sample_rate == 0) {
+      ev->scheduled_ = timestamp();
+    }
+  }
+
+  static std::int64_t timestamp() noexcept
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(timer::clock::now().time_since_epoch()).count();
+  }
+
+  void resumed(worker& self, event* ev) noexcept
+  {
+    add(self.stats.resumed, std::uint64_t(1));
+    self.batch++;
+    if (const auto scheduled = ev->scheduled_) {
+      ev->scheduled_ = 0;
+      const auto latency = static_cast<std::uint64_t>(std::max(timestamp() - scheduled, std::int64_t(0)));
+      const auto bucket = std::min(static_cast<std::size_t>(std::bit_width(latency)), std::size_t(31));
+      add(self.stats.latency[bucket], std::uint64_t(1));
+    }
+  }
+
+  // Accounts the time since the worker started or last woke up as running.
+  void ran(worker& self) noexcept
+  {
+    const auto now = timer::clock::now();
+    add(self.stats.running, std::chrono::duration_cast<std::chrono::nanoseconds>(now - self.since).count());
+    if (self.batch > self.stats.batch.load(std::memory_order_relaxed)) {
+      self.stats.batch.store(self.batch, std::memory_order_relaxed);
+    }
+    self.batch = 0;
+    self.since = now;
+  }
+
+  // Called before and after a worker blocks.
+  void parking(worker& self) noexcept
+  {
+    add(self.stats.parks, std::uint64_t(1));
+    ran(self);
+  }
+
+  void unparked(worker& self) noexcept
+  {
+    const auto now = timer::clock::now();
+    add(self.stats.parked, std::chrono::duration_cast<std::chrono::nanoseconds>(now - self.since).count());
+    self.since = now;
+  }
+
+  // Steals events from a random sibling worker when the local deque is empty.
+  event* steal(worker& self) noexcept
+  {
+    if (size_ < 2) {
+      return nullptr;
+    }
+    self.seed ^= self.seed << 13;
+    self.seed ^= self.seed >> 17;
+    self.seed ^= self.seed << 5;
+    const auto offset = self.seed % size_;
+    for (std::size_t i = 0; i < size_; i++) {
+      auto& other = workers_[(offset + i) % size_];
+      if (&other == &self) {
+        continue;
+      }
+      if (const auto ev = other.local.steal(self.local)) {
+        return ev;
+      }
+    }
+    return nullptr;
+  }
+
   std::atomic_bool stop_ = false;
-  std::atomic<event*> head_ = nullptr;
-  ice::thread_local_storage<context> index_;
-  std::condition_variable cv_;
-  std::mutex mutex_;
+  lane lanes_[3];
+  std::unique_ptr<worker[]> workers_;
+  const std::size_t size_ = 1;
+  const std::size_t spin_ = 0;
+  const std::uint32_t budget_ = 0;
+  alignas(64) std::atomic_uint32_t sleepers_ = 0;
+  ice::futex epoch_;
+  static inline ice::thread_local_storage<worker> index_;
+  static inline thread_local std::uint32_t sample_ = 0;
+  std::atomic<loop*> loop_ = nullptr;
+  alignas(64) std::atomic_uint64_t deadline_ = wheel::never;
+  std::atomic_uint64_t watched_ = wheel::never;
+  const timer::clock::time_point start_ = timer::clock::now();
+  std::mutex wheel_mutex_;
+  wheel wheel_;
 };
 
+class context_pool;
+
 class schedule final : public ice::context::event {
 public:
-  schedule(context& context, bool post = false) noexcept : context_(context), ready_(!post && context.is_current()) {}
+  schedule(context& context, bool post = false) noexcept : context_(context), ready_(!post && context.is_resumable()) {}
+
+  schedule(context& context, ice::priority priority, bool post = false) noexcept :
+    context_(context), priority_(priority), ready_(!post && context.is_resumable())
+  {}
+
+  // Selects a context from the pool. The selection counts as load of the context until the awaiter is scheduled, so
+  // that concurrent selections with the least_loaded policy spread over the pool.
+  template <typename Pool, typename = std::enable_if_t<std::is_same_v<Pool, context_pool>>>
+  schedule(Pool& pool, bool post = false) noexcept :
+    reservation_(nullptr), context_(pool.select(reservation_)), ready_(!post && context_.is_resumable())
+  {
+    if (ready_ && reservation_) {
+      reservation_->fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
 
   constexpr bool await_ready() const noexcept
   {
     return ready_;
   }
 
-  void await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+  // The awaiter can be resumed on another thread as soon as it is scheduled, so no members are accessed afterwards.
+  std::experimental::coroutine_handle<> await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
   {
     awaiter_ = awaiter;
-    context_.schedule(this);
+    const auto reservation = reservation_;
+    context_.schedule(this, priority_);
+    if (reservation) {
+      reservation->fetch_sub(1, std::memory_order_relaxed);
+    }
+    return ice::context::transfer();
   }
 
   constexpr void await_resume() const noexcept {}
 
 private:
+  std::atomic_size_t* reservation_ = nullptr;
   context& context_;
+  const ice::priority priority_ = ice::priority::normal;
   const bool ready_ = true;
 };
 
+// Moves the awaiter to the back of the queue of the context that runs on the calling thread. Does not suspend when the
+// calling thread does not run a context.
+class yield final : public ice::context::event {
+public:
+  yield() noexcept : context_(ice::context::current()) {}
+
+  bool await_ready() const noexcept
+  {
+    return !context_;
+  }
+
+  std::experimental::coroutine_handle<> await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+  {
+    awaiter_ = awaiter;
+    context_->schedule(this);
+    return ice::context::transfer();
+  }
+
+  constexpr void await_resume() const noexcept {}
+
+private:
+  ice::context* const context_;
+};
+
+// Suspended coroutine that is resumed on the context it was suspended on or inline when it was not suspended on a
+// context thread. Used by primitives that are released from other coroutines.
+class continuation final : public ice::context::event {
+public:
+  void suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+  {
+    awaiter_ = awaiter;
+    context_ = ice::context::current();
+  }
+
+  void post() noexcept
+  {
+    if (!try_post()) {
+      awaiter_.resume();
+    }
+  }
+
+  // Schedules the awaiter on the context it was suspended on. Returns false if it was not suspended on a context
+  // thread, in which case the caller is responsible for resuming it.
+  bool try_post() noexcept
+  {
+    if (!context_) {
+      return false;
+    }
+    context_->schedule(this);
+    return true;
+  }
+
+  std::experimental::coroutine_handle<> awaiter() const noexcept
+  {
+    return awaiter_;
+  }
+
+private:
+  ice::context* context_ = nullptr;
+};
+
+// Suspends the awaiter and appends the event to a container, so that suspended coroutines can be scheduled as a batch
+// with context::schedule(first, last).
+template <typename Container>
+class defer final : public ice::context::event {
+public:
+  defer(Container& events) noexcept : events_(events) {}
+
+  constexpr bool await_ready() const noexcept
+  {
+    return false;
+  }
+
+  void await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+  {
+    awaiter_ = awaiter;
+    events_.push_back(this);
+  }
+
+  constexpr void await_resume() const noexcept {}
+
+private:
+  Container& events_;
+};
+
+class sleep_until final : public ice::context::timer {
+public:
+  sleep_until(context& context, clock::time_point deadline) noexcept : timer(context, deadline) {}
+};
+
+class sleep_for final : public ice::context::timer {
+public:
+  template <typename Rep, typename Period>
+  sleep_for(context& context, std::chrono::duration<Rep, Period> duration) noexcept :
+    timer(context, clock::now() + std::chrono::ceil<clock::duration>(duration))
+  {}
+};
+
 }  // namespace ice
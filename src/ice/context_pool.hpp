@@ -0,0 +1,147 @@
+#pragma once
+#include <ice/config.hpp>
+#include <ice/context.hpp>
+#include <ice/utility.hpp>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+
+namespace ice {
+
+// Owns a set of contexts that are each run by a thread pinned to a separate logical processor.
+class context_pool {
+public:
+  enum class policy : std::uint8_t {
+    round_robin,
+    least_loaded,
+  };
+
+  context_pool(policy policy = policy::round_robin) noexcept : policy_(policy) {}
+
+  context_pool(const context_pool& other) = delete;
+  context_pool& operator=(const context_pool& other) = delete;
+
+  ~context_pool()
+  {
+    stop();
+    join();
+  }
+
+  // Starts one context per physical core or the given number of contexts on consecutive logical processors.
+  ice::error_code create(std::size_t size = 0) noexcept(ICE_NO_EXCEPTIONS)
+  {
+    assert(!size_);
+    auto cores = ice::physical_cores();
+    if (size) {
+      const auto concurrency = std::max(std::thread::hardware_concurrency(), 1u);
+      cores.resize(size);
+      for (std::size_t i = 0; i < size; i++) {
+        cores[i] = i % concurrency;
+      }
+    }
+    contexts_ = std::make_unique<context[]>(cores.size());
+    reserved_ = std::make_unique<std::atomic_size_t[]>(cores.size());
+    size_ = cores.size();
+    threads_.reserve(size_);
+    ice::error_code ec;
+    for (std::size_t i = 0; i < size_; i++) {
+      threads_.emplace_back([this, i]() { contexts_[i].run(); });
+      if (const auto rc = ice::set_thread_affinity(threads_.back(), cores[i]); rc && !ec) {
+        ec = rc;
+      }
+    }
+    return ec;
+  }
+
+  void stop() noexcept
+  {
+    for (std::size_t i = 0; i < size_; i++) {
+      contexts_[i].stop();
+    }
+  }
+
+  void join() noexcept
+  {
+    for (auto& thread : threads_) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+  }
+
+  std::size_t size() const noexcept
+  {
+    return size_;
+  }
+
+  context& operator[](std::size_t index) noexcept
+  {
+    assert(index < size_);
+    return contexts_[index];
+  }
+
+  // Selects a context according to the pool policy.
+  context& select() noexcept
+  {
+    return policy_ == policy::least_loaded ? contexts_[least_loaded_index()] : next();
+  }
+
+  // Selects a context according to the pool policy. With the least_loaded policy, the selection is reserved until the
+  // caller decrements the returned counter after scheduling an event on the context.
+  context& select(std::atomic_size_t*& reservation) noexcept
+  {
+    if (policy_ != policy::least_loaded) {
+      reservation = nullptr;
+      return next();
+    }
+    const auto index = least_loaded_index();
+    reservation = &reserved_[index];
+    reservation->fetch_add(1, std::memory_order_relaxed);
+    return contexts_[index];
+  }
+
+  // Selects the contexts in turn.
+  context& next() noexcept
+  {
+    assert(size_);
+    return contexts_[index_.fetch_add(1, std::memory_order_relaxed) % size_];
+  }
+
+  // Selects the context with fewer ready and reserved events out of two random choices.
+  context& least_loaded() noexcept
+  {
+    return contexts_[least_loaded_index()];
+  }
+
+private:
+  std::size_t least_loaded_index() noexcept
+  {
+    assert(size_);
+    auto seed = seed_.fetch_add(0x9E3779B9, std::memory_order_relaxed);
+    seed ^= seed >> 16;
+    seed *= 0x7FEB352D;
+    seed ^= seed >> 15;
+    const auto lhs = seed % size_;
+    const auto rhs = (seed >> 16) % size_;
+    return load(rhs) < load(lhs) ? rhs : lhs;
+  }
+
+  std::size_t load(std::size_t index) const noexcept
+  {
+    return contexts_[index].load() + reserved_[index].load(std::memory_order_relaxed);
+  }
+
+  std::unique_ptr<context[]> contexts_;
+  std::unique_ptr<std::atomic_size_t[]> reserved_;
+  std::size_t size_ = 0;
+  std::vector<std::thread> threads_;
+  const policy policy_ = policy::round_robin;
+  alignas(64) std::atomic_uint32_t index_ = 0;
+  std::atomic_uint32_t seed_ = 0;
+};
+
+}  // namespace ice
@@ -0,0 +1,97 @@
+#pragma once
+#include <ice/config.hpp>
+#include <new>
+#include <cstddef>
+
+namespace ice {
+
+// Allocates coroutine frames from thread-local free lists in size classes of 64 bytes up to 4 KiB.
+// Frames that are freed on another thread are cached by that thread. Larger frames use the global allocator.
+class frame_pool {
+public:
+  constexpr static std::size_t granularity = 64;
+  constexpr static std::size_t classes = 64;
+  constexpr static std::size_t limit = 256;
+
+  static void* allocate(std::size_t size) noexcept(ICE_NO_EXCEPTIONS)
+  {
+    const auto index = (size - 1) / granularity;
+    if (index < classes) {
+      auto& list = cache_.lists[index];
+      if (const auto node = list.head) {
+        list.head = node->next;
+        list.size--;
+        return node;
+      }
+      size = (index + 1) * granularity;
+    }
+    return ::operator new(size);
+  }
+
+  static void deallocate(void* frame, std::size_t size) noexcept
+  {
+    const auto index = (size - 1) / granularity;
+    if (index < classes) {
+      if (auto& list = cache_.lists[index]; list.size < limit) {
+        list.head = ::new (frame) node{ list.head };
+        list.size++;
+        return;
+      }
+    }
+    ::operator delete(frame);
+  }
+
+private:
+  struct node {
+    node* next = nullptr;
+  };
+
+  struct list {
+    node* head = nullptr;
+    std::size_t size = 0;
+  };
+
+  struct cache {
+    cache() noexcept {}
+
+    cache(const cache& other) = delete;
+    cache& operator=(const cache& other) = delete;
+
+    ~cache()
+    {
+      for (auto& list : lists) {
+        while (const auto frame = list.head) {
+          list.head = frame->next;
+          ::operator delete(frame);
+        }
+      }
+    }
+
+    list lists[classes];
+  };
+
+  static inline thread_local cache cache_;
+};
+
+// Provides promise level allocation functions that use the given allocator.
+// Coroutine types opt in with an allocator template parameter like ice::task<T, ice::frame_pool>.
+template <typename Allocator>
+class frame {
+public:
+  // Not noexcept, which would require get_return_object_on_allocation_failure in the promise.
+  static void* operator new(std::size_t size)
+  {
+    return Allocator::allocate(size);
+  }
+
+  static void operator delete(void* frame, std::size_t size) noexcept
+  {
+    Allocator::deallocate(frame, size);
+  }
+};
+
+// Uses the global allocation functions.
+template <>
+class frame<void> {};
+
+}  // namespace ice
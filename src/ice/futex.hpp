@@ -0,0 +1,126 @@
+#pragma once
+#include <ice/config.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+
+#if ICE_OS_WIN32
+#include <windows.h>
+#elif ICE_OS_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#elif ICE_OS_FREEBSD
+#include <sys/types.h>
+#include <sys/umtx.h>
+#include <ctime>
+#endif
+
+namespace ice {
+
+// Atomic 32-bit value that threads can block on until it is changed and notified.
+class futex {
+public:
+  using value_type = std::uint32_t;
+
+  constexpr futex(value_type value = 0) noexcept : value_(value) {}
+
+  futex(const futex& other) = delete;
+  futex& operator=(const futex& other) = delete;
+
+  value_type load(std::memory_order order = std::memory_order_seq_cst) const noexcept
+  {
+    return value_.load(order);
+  }
+
+  void store(value_type value, std::memory_order order = std::memory_order_seq_cst) noexcept
+  {
+    value_.store(value, order);
+  }
+
+  value_type fetch_add(value_type value, std::memory_order order = std::memory_order_seq_cst) noexcept
+  {
+    return value_.fetch_add(value, order);
+  }
+
+  value_type exchange(value_type value, std::memory_order order = std::memory_order_seq_cst) noexcept
+  {
+    return value_.exchange(value, order);
+  }
+
+  bool compare_exchange_strong(
+    value_type& expected,
+    value_type value,
+    std::memory_order order = std::memory_order_seq_cst) noexcept
+  {
+    return value_.compare_exchange_strong(expected, value, order);
+  }
+
+  // Blocks while the value is equal to the expected value. Can return spuriously.
+  void wait(value_type expected) noexcept
+  {
+#if ICE_OS_WIN32
+    ::WaitOnAddress(&value_, &expected, sizeof(expected), INFINITE);
+#elif ICE_OS_LINUX
+    ::syscall(SYS_futex, &value_, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#elif ICE_OS_FREEBSD
+    ::_umtx_op(&value_, UMTX_OP_WAIT_UINT_PRIVATE, expected, nullptr, nullptr);
+#endif
+  }
+
+  // Blocks while the value is equal to the expected value or until the timeout expires. Can return spuriously.
+  void wait(value_type expected, std::chrono::nanoseconds timeout) noexcept
+  {
+    if (timeout <= std::chrono::nanoseconds::zero()) {
+      return;
+    }
+#if ICE_OS_WIN32
+    const auto ms = std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+    const auto wait = static_cast<DWORD>(std::min<long long>(ms, INFINITE - 1));
+    ::WaitOnAddress(&value_, &expected, sizeof(expected), wait);
+#else
+    const auto s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec ts = {};
+    ts.tv_sec = static_cast<decltype(ts.tv_sec)>(s.count());
+    ts.tv_nsec = static_cast<decltype(ts.tv_nsec)>((timeout - s).count());
+#if ICE_OS_LINUX
+    ::syscall(SYS_futex, &value_, FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+#elif ICE_OS_FREEBSD
+    _umtx_time ut = {};
+    ut._timeout = ts;
+    ut._clockid = CLOCK_MONOTONIC;
+    ::_umtx_op(&value_, UMTX_OP_WAIT_UINT_PRIVATE, expected, reinterpret_cast<void*>(sizeof(ut)), &ut);
+#endif
+#endif
+  }
+
+  void notify_one() noexcept
+  {
+#if ICE_OS_WIN32
+    ::WakeByAddressSingle(&value_);
+#elif ICE_OS_LINUX
+    ::syscall(SYS_futex, &value_, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#elif ICE_OS_FREEBSD
+    ::_umtx_op(&value_, UMTX_OP_WAKE_PRIVATE, 1, nullptr, nullptr);
+#endif
+  }
+
+  void notify_all() noexcept
+  {
+#if ICE_OS_WIN32
+    ::WakeByAddressAll(&value_);
+#elif ICE_OS_LINUX
+    ::syscall(SYS_futex, &value_, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#elif ICE_OS_FREEBSD
+    ::_umtx_op(&value_, UMTX_OP_WAKE_PRIVATE, INT_MAX, nullptr, nullptr);
+#endif
+  }
+
+private:
+  std::atomic<value_type> value_;
+};
+
+}  // namespace ice
@@ -0,0 +1,339 @@
+#pragma once
+#include <ice/config.hpp>
+#include <ice/context.hpp>
+#include <atomic>
+#include <experimental/coroutine>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+#include <cstddef>
+
+#if ICE_EXCEPTIONS
+#include <exception>
+#endif
+
+namespace ice {
+
+// Lazily started coroutine that produces values with co_yield. The producer runs ahead of the consumer by at most
+// Capacity values and is suspended when the buffer is full. The consumer is suspended when the buffer is empty.
+// Both sides are resumed on the context they were suspended on, so they can run on different contexts. A side that
+// does not run on a context is resumed with symmetric transfer when the other side suspends.
+//
+// for co_await (auto& value : generator) { ... }
+// for (auto it = co_await generator.begin(); it != generator.end(); co_await ++it) { ... }
+//
+// The producer must not be running when the generator is destroyed.
+template <typename T, std::size_t Capacity = 1>
+class async_generator {
+public:
+  static_assert(Capacity > 0);
+
+  class promise_type {
+  public:
+    async_generator get_return_object() noexcept
+    {
+      return { handle_type::from_promise(*this) };
+    }
+
+    constexpr auto initial_suspend() const noexcept
+    {
+      return std::experimental::suspend_always{};
+    }
+
+    auto final_suspend() noexcept
+    {
+      struct awaitable {
+        constexpr bool await_ready() const noexcept
+        {
+          return false;
+        }
+
+        std::experimental::coroutine_handle<> await_suspend(
+          std::experimental::coroutine_handle<promise_type> handle) noexcept
+        {
+          return handle.promise().finish();
+        }
+
+        constexpr void await_resume() const noexcept {}
+      };
+      return awaitable{};
+    }
+
+    template <typename U>
+    auto yield_value(U&& value) noexcept(ICE_NO_EXCEPTIONS || std::is_nothrow_constructible_v<T, U>)
+    {
+      struct awaitable {
+        bool await_ready() noexcept
+        {
+          return stored_ = promise_.push(value_);
+        }
+
+        std::experimental::coroutine_handle<> await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+        {
+          const auto consumer = std::exchange(promise_.consumer_pending_, false);
+          promise_.producer_.suspend(awaiter);
+          if (!promise_.wait(producer_waiting)) {
+            promise_.consumer_pending_ = consumer;
+            return awaiter;
+          }
+          return consumer ? promise_.consumer_.awaiter() : std::experimental::noop_coroutine();
+        }
+
+        void await_resume() noexcept
+        {
+          if (!stored_) {
+            [[maybe_unused]] const auto stored = promise_.push(value_);
+            assert(stored);
+          }
+        }
+
+        promise_type& promise_;
+        T value_;
+        bool stored_ = false;
+      };
+      return awaitable{ *this, T(std::forward<U>(value)) };
+    }
+
+    constexpr void return_void() const noexcept {}
+
+#if ICE_EXCEPTIONS || defined(__clang__)
+    void unhandled_exception() noexcept
+    {
+#if ICE_EXCEPTIONS
+      exception_ = std::current_exception();
+#endif
+    }
+#endif
+
+  private:
+    friend class async_generator;
+
+    constexpr static std::size_t consumer_waiting = 1;
+    constexpr static std::size_t producer_waiting = 2;
+    constexpr static std::size_t finished = 4;
+    constexpr static std::size_t one = 8;
+
+    static constexpr std::size_t size(std::size_t state) noexcept
+    {
+      return state / one;
+    }
+
+    // Schedules a waiting side on its context. A side that did not wait on a context thread is resumed with symmetric
+    // transfer when the calling side suspends instead of inline on its stack.
+    static void wake(ice::continuation& side, bool& pending) noexcept
+    {
+      if (!side.try_post()) {
+        pending = true;
+      }
+    }
+
+    // Stores a value if the buffer is not full and resumes a waiting consumer.
+    bool push(T& value) noexcept(ICE_NO_EXCEPTIONS || std::is_nothrow_move_constructible_v<T>)
+    {
+      auto state = state_.load(std::memory_order_acquire);
+      if (size(state) == Capacity) {
+        return false;
+      }
+      slots_[tail_++ % Capacity].emplace(std::move(value));
+      while (!state_.compare_exchange_weak(state, (state + one) & ~consumer_waiting, std::memory_order_acq_rel)) {
+      }
+      if (state & consumer_waiting) {
+        wake(consumer_, consumer_pending_);
+      }
+      return true;
+    }
+
+    // Takes a value if the buffer is not empty and resumes a waiting producer.
+    bool pop() noexcept(ICE_NO_EXCEPTIONS || std::is_nothrow_move_constructible_v<T>)
+    {
+      auto state = state_.load(std::memory_order_acquire);
+      if (size(state) == 0) {
+        return false;
+      }
+      auto& slot = slots_[head_++ % Capacity];
+      current_.emplace(std::move(*slot));
+      slot.reset();
+      while (!state_.compare_exchange_weak(state, (state - one) & ~producer_waiting, std::memory_order_acq_rel)) {
+      }
+      if (state & producer_waiting) {
+        wake(producer_, producer_pending_);
+      }
+      return true;
+    }
+
+    // Marks the side as waiting while the buffer is still full or empty. Returns false if it changed in between.
+    bool wait(std::size_t flag) noexcept
+    {
+      auto state = state_.load(std::memory_order_acquire);
+      while (flag == producer_waiting ? size(state) == Capacity : size(state) == 0 && !(state & finished)) {
+        if (state_.compare_exchange_weak(state, state | flag, std::memory_order_acq_rel)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Marks the end of the stream. Returns the consumer if the producer has to resume it.
+    std::experimental::coroutine_handle<> finish() noexcept
+    {
+      const auto pending = std::exchange(consumer_pending_, false);
+      auto state = state_.load(std::memory_order_acquire);
+      while (!state_.compare_exchange_weak(state, (state | finished) & ~consumer_waiting, std::memory_order_acq_rel)) {
+      }
+      if (pending || ((state & consumer_waiting) && !consumer_.try_post())) {
+        return consumer_.awaiter();
+      }
+      return std::experimental::noop_coroutine();
+    }
+
+    // Returns true if the consumer has a value, false at the end of the stream.
+    bool next() noexcept(ICE_NO_EXCEPTIONS)
+    {
+      if (pop()) {
+        return true;
+      }
+      current_.reset();
+#if ICE_EXCEPTIONS
+      if (exception_) {
+        std::rethrow_exception(std::exchange(exception_, nullptr));
+      }
+#endif
+      return false;
+    }
+
+    // The promise lives in the coroutine frame, which is only aligned like operator new, so members are not padded to
+    // cache lines. Each side owns the pending flag of the other side, which it resumes when it suspends.
+    std::optional<T> slots_[Capacity];
+    std::size_t tail_ = 0;
+    ice::continuation producer_;
+    bool consumer_pending_ = false;
+    std::atomic_size_t state_ = 0;
+    std::size_t head_ = 0;
+    std::optional<T> current_;
+    ice::continuation consumer_;
+    bool producer_pending_ = false;
+    bool started_ = false;
+#if ICE_EXCEPTIONS
+    std::exception_ptr exception_;
+#endif
+  };
+
+  using handle_type = std::experimental::coroutine_handle<promise_type>;
+
+  class iterator {
+  public:
+    using value_type = T;
+    using reference = T&;
+    using pointer = T*;
+    using difference_type = std::ptrdiff_t;
+
+    iterator(handle_type handle = nullptr) noexcept : handle_(handle) {}
+
+    // Advances to the next value.
+    auto operator++() noexcept
+    {
+      return awaitable{ *this };
+    }
+
+    T& operator*() const noexcept
+    {
+      return *handle_.promise().current_;
+    }
+
+    T* operator->() const noexcept
+    {
+      return &*handle_.promise().current_;
+    }
+
+    friend bool operator==(const iterator& lhs, const iterator& rhs) noexcept
+    {
+      return lhs.handle_ == rhs.handle_;
+    }
+
+    friend bool operator!=(const iterator& lhs, const iterator& rhs) noexcept
+    {
+      return lhs.handle_ != rhs.handle_;
+    }
+
+  private:
+    friend class async_generator;
+
+    struct awaitable {
+      bool await_ready() noexcept
+      {
+        return ready_ = it_.handle_.promise().pop();
+      }
+
+      std::experimental::coroutine_handle<> await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+      {
+        auto& promise = it_.handle_.promise();
+        const std::experimental::coroutine_handle<> producer = it_.handle_;
+        const auto start = !std::exchange(promise.started_, true);
+        const auto resume = std::exchange(promise.producer_pending_, false) || start;
+        promise.consumer_.suspend(awaiter);
+        if (!promise.wait(promise_type::consumer_waiting)) {
+          promise.producer_pending_ = resume;
+          return awaiter;
+        }
+        return resume ? producer : std::experimental::noop_coroutine();
+      }
+
+      iterator& await_resume() noexcept(ICE_NO_EXCEPTIONS)
+      {
+        if (!ready_ && !it_.handle_.promise().next()) {
+          it_.handle_ = nullptr;
+        }
+        return it_;
+      }
+
+      iterator& it_;
+      bool ready_ = false;
+    };
+
+    handle_type handle_;
+  };
+
+  async_generator(handle_type handle) noexcept : handle_(handle) {}
+
+  async_generator(async_generator&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+  async_generator& operator=(async_generator&& other) noexcept
+  {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+
+  async_generator(const async_generator& other) = delete;
+  async_generator& operator=(const async_generator& other) = delete;
+
+  ~async_generator()
+  {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  // Starts the producer and waits for the first value.
+  auto begin() noexcept
+  {
+    begin_ = iterator{ handle_ };
+    return typename iterator::awaitable{ begin_ };
+  }
+
+  iterator end() const noexcept
+  {
+    return {};
+  }
+
+private:
+  handle_type handle_;
+  iterator begin_;
+};
+
+}  // namespace ice
@@ -0,0 +1,360 @@
+#pragma once
+#include <ice/config.hpp>
+#include <ice/context.hpp>
+#include <algorithm>
+#include <atomic>
+#include <experimental/coroutine>
+#include <utility>
+#include <cassert>
+#include <cstdint>
+
+namespace ice {
+
+// Counter with a list of suspended coroutines. A negative value is the number of waiters. Waiters are resumed on the
+// context they were suspended on, or inline by the thread that releases them when they did not run on a context.
+class async_waiters {
+public:
+  async_waiters(const async_waiters& other) = delete;
+  async_waiters& operator=(const async_waiters& other) = delete;
+
+protected:
+  class waiter {
+  public:
+    waiter(async_waiters& waiters) noexcept : waiters_(waiters) {}
+
+    // Decrements the counter and suspends the awaiter if it was not positive. The counter is left unchanged when it is
+    // positive and the caller does not consume it.
+    bool suspend(std::experimental::coroutine_handle<> awaiter, bool consume = true) noexcept
+    {
+      continuation_.suspend(awaiter);
+      auto value = waiters_.value_.load(std::memory_order_acquire);
+      do {
+        if (value > 0 && !consume) {
+          return false;
+        }
+      } while (!waiters_.value_.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel));
+      if (value > 0) {
+        return false;
+      }
+      return waiters_.push(this);
+    }
+
+  private:
+    friend class async_waiters;
+    async_waiters& waiters_;
+    ice::continuation continuation_;
+    waiter* next_ = nullptr;
+  };
+
+  async_waiters(std::int64_t value) noexcept : value_(value) {}
+
+  // Resumes the given number of waiters that decremented the counter. A single thread resumes waiters at a time.
+  void wake(std::size_t count) noexcept
+  {
+    if (pending_.fetch_add(count, std::memory_order_acq_rel) != 0) {
+      return;
+    }
+    resume(count);
+  }
+
+  alignas(64) std::atomic_int64_t value_;
+
+private:
+  // Marks the list of incoming waiters while wakeups are owed to waiters that decremented the counter but were not
+  // pushed yet. The next waiter that pushes itself takes over the wakeups instead.
+  static waiter* parked() noexcept
+  {
+    return reinterpret_cast<waiter*>(std::uintptr_t(1));
+  }
+
+  // Pushes the waiter. Returns false without pushing it if wakeups were parked, in which case the waiter is resumed by
+  // the caller and the calling thread resumes the remaining owed waiters.
+  bool push(waiter* node) noexcept
+  {
+    auto head = incoming_.load(std::memory_order_relaxed);
+    while (true) {
+      if (head == parked()) {
+        if (incoming_.compare_exchange_weak(head, nullptr, std::memory_order_acquire, std::memory_order_relaxed)) {
+          if (const auto count = pending_.fetch_sub(1, std::memory_order_acq_rel) - 1) {
+            resume(count);
+          }
+          return false;
+        }
+        continue;
+      }
+      node->next_ = head;
+      if (incoming_.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+  }
+
+  // Resumes count waiters and then the waiters that were added to the owed wakeups in the meantime. Parks the owed
+  // wakeups and returns if the waiters that decremented the counter were not pushed yet.
+  void resume(std::size_t count) noexcept
+  {
+    while (true) {
+      std::size_t done = 0;
+      for (; done < count; done++) {
+        const auto node = pop();
+        if (!node) {
+          break;
+        }
+        node->continuation_.post();
+      }
+      if (done < count) {
+        // The owed wakeups stay above zero, so that wake does not resume waiters while they are parked.
+        pending_.fetch_sub(done, std::memory_order_acq_rel);
+        auto head = static_cast<waiter*>(nullptr);
+        if (incoming_.compare_exchange_strong(head, parked(), std::memory_order_release, std::memory_order_relaxed)) {
+          return;
+        }
+        count = pending_.load(std::memory_order_acquire);
+        continue;
+      }
+      if ((count = pending_.fetch_sub(count, std::memory_order_acq_rel) - count) == 0) {
+        return;
+      }
+    }
+  }
+
+  // Returns the next pushed waiter or nullptr.
+  waiter* pop() noexcept
+  {
+    if (!waiters_) {
+      auto head = incoming_.exchange(nullptr, std::memory_order_acquire);
+      if (!head) {
+        return nullptr;
+      }
+      do {
+        waiters_ = std::exchange(head, std::exchange(head->next_, waiters_));
+      } while (head);
+    }
+    return std::exchange(waiters_, waiters_->next_);
+  }
+
+  std::atomic<waiter*> incoming_ = nullptr;
+  alignas(64) std::atomic_size_t pending_ = 0;
+  waiter* waiters_ = nullptr;
+};
+
+// Counting semaphore that suspends coroutines instead of blocking the thread.
+class async_semaphore : public async_waiters {
+public:
+  class acquire_awaitable : public waiter {
+  public:
+    acquire_awaitable(async_semaphore& semaphore) noexcept : waiter(semaphore), semaphore_(semaphore) {}
+
+    bool await_ready() noexcept
+    {
+      return semaphore_.try_acquire();
+    }
+
+    bool await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+    {
+      return suspend(awaiter);
+    }
+
+    constexpr void await_resume() const noexcept {}
+
+  private:
+    async_semaphore& semaphore_;
+  };
+
+  explicit async_semaphore(std::int64_t value = 0) noexcept : async_waiters(value)
+  {
+    assert(value >= 0);
+  }
+
+  bool try_acquire() noexcept
+  {
+    auto value = value_.load(std::memory_order_acquire);
+    while (value > 0) {
+      if (value_.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  acquire_awaitable acquire() noexcept
+  {
+    return { *this };
+  }
+
+  // Releases the given number of units and resumes as many waiters.
+  void release(std::size_t count = 1) noexcept
+  {
+    const auto value = value_.fetch_add(static_cast<std::int64_t>(count), std::memory_order_acq_rel);
+    if (value < 0) {
+      wake(std::min(count, static_cast<std::size_t>(-value)));
+    }
+  }
+};
+
+// Mutex that suspends coroutines instead of blocking the thread. The lock is handed over to the next waiter on unlock.
+class async_mutex : public async_waiters {
+public:
+  class lock_awaitable : public waiter {
+  public:
+    lock_awaitable(async_mutex& mutex) noexcept : waiter(mutex), mutex_(mutex) {}
+
+    bool await_ready() noexcept
+    {
+      return mutex_.try_lock();
+    }
+
+    bool await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+    {
+      return suspend(awaiter);
+    }
+
+    constexpr void await_resume() const noexcept {}
+
+  protected:
+    async_mutex& mutex_;
+  };
+
+  // Unlocks the mutex when destroyed.
+  class lock_guard {
+  public:
+    explicit lock_guard(async_mutex& mutex) noexcept : mutex_(&mutex) {}
+
+    lock_guard(lock_guard&& other) noexcept : mutex_(std::exchange(other.mutex_, nullptr)) {}
+
+    lock_guard(const lock_guard& other) = delete;
+    lock_guard& operator=(const lock_guard& other) = delete;
+
+    ~lock_guard()
+    {
+      if (mutex_) {
+        mutex_->unlock();
+      }
+    }
+
+  private:
+    async_mutex* mutex_;
+  };
+
+  class scoped_lock_awaitable : public lock_awaitable {
+  public:
+    using lock_awaitable::lock_awaitable;
+
+    lock_guard await_resume() const noexcept
+    {
+      return lock_guard{ mutex_ };
+    }
+  };
+
+  async_mutex() noexcept : async_waiters(1) {}
+
+  bool try_lock() noexcept
+  {
+    auto value = std::int64_t(1);
+    return value_.compare_exchange_strong(value, 0, std::memory_order_acq_rel);
+  }
+
+  lock_awaitable lock() noexcept
+  {
+    return { *this };
+  }
+
+  // Locks the mutex and returns a lock_guard.
+  scoped_lock_awaitable scoped_lock() noexcept
+  {
+    return { *this };
+  }
+
+  void unlock() noexcept
+  {
+    const auto value = value_.fetch_add(1, std::memory_order_acq_rel);
+    assert(value <= 0);
+    if (value < 0) {
+      wake(1);
+    }
+  }
+};
+
+// Event that resumes all waiters when set and stays set until it is reset (manual) or resumes a single waiter and
+// resets itself when there are waiters (automatic).
+class async_event : public async_waiters {
+public:
+  enum class mode : std::uint8_t {
+    manual,
+    automatic,
+  };
+
+  class wait_awaitable : public waiter {
+  public:
+    wait_awaitable(async_event& event) noexcept : waiter(event), event_(event) {}
+
+    bool await_ready() noexcept
+    {
+      return event_.try_wait();
+    }
+
+    bool await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+    {
+      return suspend(awaiter, event_.mode_ == mode::automatic);
+    }
+
+    constexpr void await_resume() const noexcept {}
+
+  private:
+    async_event& event_;
+  };
+
+  explicit async_event(mode mode = mode::manual, bool set = false) noexcept : async_waiters(set ? 1 : 0), mode_(mode) {}
+
+  bool is_set() const noexcept
+  {
+    return value_.load(std::memory_order_acquire) == 1;
+  }
+
+  // Returns true if the event is set and resets it when the event resets automatically.
+  bool try_wait() noexcept
+  {
+    auto value = value_.load(std::memory_order_acquire);
+    while (value == 1) {
+      if (mode_ == mode::manual || value_.compare_exchange_weak(value, 0, std::memory_order_acq_rel)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  wait_awaitable wait() noexcept
+  {
+    return { *this };
+  }
+
+  void set() noexcept
+  {
+    if (mode_ == mode::manual) {
+      if (const auto value = value_.exchange(1, std::memory_order_acq_rel); value < 0) {
+        wake(static_cast<std::size_t>(-value));
+      }
+      return;
+    }
+    auto value = value_.load(std::memory_order_acquire);
+    do {
+      if (value == 1) {
+        return;
+      }
+    } while (!value_.compare_exchange_weak(value, value + 1, std::memory_order_acq_rel));
+    if (value < 0) {
+      wake(1);
+    }
+  }
+
+  void reset() noexcept
+  {
+    auto value = std::int64_t(1);
+    value_.compare_exchange_strong(value, 0, std::memory_order_acq_rel);
+  }
+
+private:
+  const mode mode_;
+};
+
+}  // namespace ice
@@ -1,3 +1,469 @@
 #pragma once
+#include <ice/config.hpp>
+#include <ice/error.hpp>
+#include <ice/service.hpp>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <cstdint>
+#include <cstring>
 
-namespace ice::net {}
+#if !ICE_OS_WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <cerrno>
+#endif
+
+namespace ice::net {
+
+#if !ICE_OS_WIN32
+
+// Result of a send or receive operation. The size is the number of bytes transferred before the error occurred.
+struct io_result {
+  std::size_t size = 0;
+  ice::error_code ec;
+};
+
+// IPv4 or IPv6 address and port.
+class endpoint {
+public:
+  endpoint() noexcept = default;
+
+  ice::error_code create(std::string_view host, std::uint16_t port) noexcept
+  {
+    char buffer[INET6_ADDRSTRLEN] = {};
+    if (host.size() >= sizeof(buffer)) {
+      return EINVAL;
+    }
+    std::memcpy(buffer, host.data(), host.size());
+    storage_ = {};
+    const auto v4 = reinterpret_cast<sockaddr_in*>(&storage_);
+    if (::inet_pton(AF_INET, buffer, &v4->sin_addr) == 1) {
+      v4->sin_family = AF_INET;
+      v4->sin_port = htons(port);
+      size_ = sizeof(sockaddr_in);
+      return {};
+    }
+    const auto v6 = reinterpret_cast<sockaddr_in6*>(&storage_);
+    if (::inet_pton(AF_INET6, buffer, &v6->sin6_addr) == 1) {
+      v6->sin6_family = AF_INET6;
+      v6->sin6_port = htons(port);
+      size_ = sizeof(sockaddr_in6);
+      return {};
+    }
+    size_ = 0;
+    return EINVAL;
+  }
+
+  int family() const noexcept
+  {
+    return storage_.ss_family;
+  }
+
+  std::uint16_t port() const noexcept
+  {
+    switch (family()) {
+    case AF_INET: return ntohs(reinterpret_cast<const sockaddr_in*>(&storage_)->sin_port);
+    case AF_INET6: return ntohs(reinterpret_cast<const sockaddr_in6*>(&storage_)->sin6_port);
+    }
+    return 0;
+  }
+
+  sockaddr* data() noexcept
+  {
+    return reinterpret_cast<sockaddr*>(&storage_);
+  }
+
+  const sockaddr* data() const noexcept
+  {
+    return reinterpret_cast<const sockaddr*>(&storage_);
+  }
+
+  socklen_t size() const noexcept
+  {
+    return size_;
+  }
+
+  socklen_t capacity() const noexcept
+  {
+    return sizeof(storage_);
+  }
+
+  void resize(socklen_t size) noexcept
+  {
+    size_ = size;
+  }
+
+private:
+  sockaddr_storage storage_ = {};
+  socklen_t size_ = 0;
+};
+
+// Non-blocking socket that is driven by a service. Operations try the system call first and only wait for readiness
+// when it would block. On Linux, the socket is registered with the epoll backend once for both directions, so that a
+// receive and a send can be pending at the same time. With the io_uring backend, operations are submitted to the
+// service and complete without a readiness step. Awaiters are resumed by the thread that runs the service. At most one
+// operation per direction can be pending at a time.
+class socket {
+public:
+  using handle_type = ice::service::handle_type;
+
+  explicit socket(ice::service& service) noexcept : service_(service) {}
+
+  socket(socket&& other) noexcept : service_(other.service_), handle_(std::move(other.handle_))
+  {
+#if ICE_OS_LINUX
+    descriptor_ = std::exchange(other.descriptor_, nullptr);
+    multishot_ = std::exchange(other.multishot_, nullptr);
+#endif
+  }
+
+  socket(const socket& other) = delete;
+  socket& operator=(const socket& other) = delete;
+
+  virtual ~socket()
+  {
+    reset({});
+  }
+
+  ice::error_code create(int family, int type, int protocol = 0) noexcept
+  {
+    handle_type handle(::socket(family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol));
+    if (!handle) {
+      return errno;
+    }
+    reset(std::move(handle));
+    return {};
+  }
+
+  ice::error_code bind(const ice::net::endpoint& endpoint) noexcept
+  {
+    if (::bind(handle_, endpoint.data(), endpoint.size()) < 0) {
+      return errno;
+    }
+    return {};
+  }
+
+  ice::error_code set(int level, int name, int value) noexcept
+  {
+    if (::setsockopt(handle_, level, name, &value, sizeof(value)) < 0) {
+      return errno;
+    }
+    return {};
+  }
+
+  ice::error_code local(ice::net::endpoint& endpoint) const noexcept
+  {
+    auto size = endpoint.capacity();
+    if (::getsockname(handle_, endpoint.data(), &size) < 0) {
+      return errno;
+    }
+    endpoint.resize(size);
+    return {};
+  }
+
+  ice::error_code remote(ice::net::endpoint& endpoint) const noexcept
+  {
+    auto size = endpoint.capacity();
+    if (::getpeername(handle_, endpoint.data(), &size) < 0) {
+      return errno;
+    }
+    endpoint.resize(size);
+    return {};
+  }
+
+  void close() noexcept
+  {
+    reset({});
+  }
+
+  constexpr explicit operator bool() const noexcept
+  {
+    return handle_.valid();
+  }
+
+  ice::service& service() const noexcept
+  {
+    return service_;
+  }
+
+  constexpr handle_type::value_type handle() const noexcept
+  {
+    return handle_;
+  }
+
+protected:
+  enum class direction {
+    recv,
+    send,
+  };
+
+#if ICE_OS_LINUX
+  class multishot;
+#endif
+
+  // Operation that is resumed by the service when the socket becomes ready. Derived classes implement attempt, which
+  // returns false when the system call would block. On the io_uring backend, derived classes implement prepare and
+  // finish instead, which fill in the submission and handle its result.
+  class operation : public ice::service::event {
+  public:
+    operation(ice::net::socket& socket, direction direction) noexcept : socket_(socket), direction_(direction) {}
+
+    bool await_ready() noexcept
+    {
+#if ICE_OS_LINUX
+      if (socket_.service_.uring()) {
+        return start();
+      }
+#endif
+      return attempt();
+    }
+
+    // Registers the operation with the service. No members are accessed after the registration because the awaiter can
+    // be resumed by another thread right away.
+    bool suspend() noexcept override
+    {
+#if ICE_OS_LINUX
+      if (socket_.service_.uring()) {
+        return submit();
+      }
+#endif
+      while (true) {
+        auto ready = false;
+        if (const auto ec = socket_.wait(this, direction_, ready)) {
+          ec_ = ec;
+          return false;
+        }
+        if (!ready) {
+          return true;
+        }
+        if (attempt()) {
+          return false;
+        }
+      }
+    }
+
+    bool resume() noexcept override
+    {
+#if ICE_OS_LINUX
+      if (socket_.service_.uring()) {
+        return finish(result_);
+      }
+#endif
+      return attempt();
+    }
+
+    // Resumes the awaiter with ECANCELED after the socket released the handle that the operation waited for.
+    void cancel() noexcept
+    {
+      ec_ = ECANCELED;
+      awaiter_.resume();
+    }
+
+  protected:
+#if ICE_OS_LINUX
+    friend class multishot;
+
+    // Returns true if the operation completed before it was submitted.
+    virtual bool start() noexcept
+    {
+      return false;
+    }
+
+    virtual void prepare(io_uring_sqe& sqe) noexcept = 0;
+
+    // Handles the completion result. Returns false if the operation has to be submitted again.
+    virtual bool finish(std::int32_t result) noexcept = 0;
+
+    bool submit() noexcept
+    {
+      if (const auto ec = socket_.service_.submit(*this, [this](io_uring_sqe& sqe) { prepare(sqe); })) {
+        ec_ = ec;
+        return false;
+      }
+      return true;
+    }
+#endif
+
+    virtual bool attempt() noexcept = 0;
+
+    // Returns true if the error is not caused by a system call that would block.
+    bool complete(int error) noexcept
+    {
+      if (error == EAGAIN || error == EWOULDBLOCK) {
+        return false;
+      }
+      ec_ = error;
+      return true;
+    }
+
+    ice::net::socket& socket_;
+    const direction direction_;
+    ice::error_code ec_;
+  };
+
+#if ICE_OS_LINUX
+  // Multishot io_uring operation that keeps producing results for a socket. Results that arrive while no operation
+  // waits are queued. The state is deleted once the socket releases it and the service reports the final completion.
+  class multishot : public ice::service::completion {
+  public:
+    explicit multishot(ice::net::socket& socket) noexcept : service_(socket.service_), handle_(socket.handle_) {}
+
+    // Completes the operation with a queued result or registers it as the waiter. Returns false if the operation
+    // completed without suspending.
+    bool wait(operation& op) noexcept
+    {
+      std::lock_guard lock(mutex_);
+      if (take(op, op.result_)) {
+        op.finish(op.result_);
+        return false;
+      }
+      if (!armed_) {
+        if (const auto ec = service_.submit(*this, [this](io_uring_sqe& sqe) { prepare(sqe); })) {
+          op.ec_ = ec;
+          return false;
+        }
+        armed_ = true;
+      }
+      waiter_ = &op;
+      return true;
+    }
+
+    // Cancels the operation and deletes the state after the final completion. Returns the waiting operation, which the
+    // caller has to cancel.
+    operation* orphan() noexcept
+    {
+      std::unique_lock lock(mutex_);
+      const auto waiter = std::exchange(waiter_, nullptr);
+      if (!armed_) {
+        lock.unlock();
+        delete this;
+        return waiter;
+      }
+      orphaned_ = true;
+      service_.cancel(*this);
+      return waiter;
+    }
+
+    void complete(std::int32_t result, std::uint32_t flags) noexcept override
+    {
+      std::unique_lock lock(mutex_);
+      if (!(flags & IORING_CQE_F_MORE)) {
+        armed_ = false;
+      }
+      if (orphaned_) {
+        discard(result, flags);
+        if (!armed_) {
+          lock.unlock();
+          delete this;
+        }
+        return;
+      }
+      if (result >= 0) {
+        push(result, flags);
+      }
+      if (const auto op = waiter_) {
+        if (take(*op, op->result_)) {
+          waiter_ = nullptr;
+          lock.unlock();
+          op->ice::service::event::await_resume();
+        } else if (!armed_) {
+          // The multishot operation stopped without a result, for example because it ran out of provided buffers.
+          // The waiter falls back to a single operation, which also reports errors.
+          waiter_ = nullptr;
+          lock.unlock();
+          if (!op->submit()) {
+            op->awaiter_.resume();
+          }
+        }
+      }
+    }
+
+  protected:
+    virtual void prepare(io_uring_sqe& sqe) noexcept = 0;
+
+    // Queues a result.
+    virtual void push(std::int32_t result, std::uint32_t flags) noexcept = 0;
+
+    // Moves the next queued result into the operation. Returns false if no results are queued.
+    virtual bool take(operation& op, std::int32_t& result) noexcept = 0;
+
+    // Releases the resources of a result after the socket released the state.
+    virtual void discard(std::int32_t result, std::uint32_t flags) noexcept = 0;
+
+    ice::service& service_;
+    const int handle_;
+
+  private:
+    std::mutex mutex_;
+    operation* waiter_ = nullptr;
+    bool armed_ = false;
+    bool orphaned_ = false;
+  };
+
+  // Replaces the handle and releases the registration and multishot state of the previous one. Operations that wait for
+  // the previous handle complete with ECANCELED. Operations submitted to io_uring are resumed by the thread that runs
+  // the service and all others by the calling thread after the handle was replaced.
+  void reset(handle_type handle) noexcept
+  {
+    operation* waiters[3] = {};
+    if (const auto descriptor = std::exchange(descriptor_, nullptr)) {
+      waiters[0] = static_cast<operation*>(descriptor->take(ice::service::descriptor::read));
+      waiters[1] = static_cast<operation*>(descriptor->take(ice::service::descriptor::write));
+      service_.release(descriptor);
+    }
+    if (const auto multishot = std::exchange(multishot_, nullptr)) {
+      waiters[2] = multishot->orphan();
+    }
+    if (handle_) {
+      service_.close(std::move(handle_));
+    }
+    handle_ = std::move(handle);
+    for (const auto waiter : waiters) {
+      if (waiter) {
+        waiter->cancel();
+      }
+    }
+  }
+#else
+  void reset(handle_type handle) noexcept
+  {
+    handle_ = std::move(handle);
+  }
+#endif
+
+  // Waits until the socket can be read from or written to and resumes the operation once. Sets ready instead of
+  // registering the operation if the socket became ready since the last operation in this direction was resumed.
+  ice::error_code wait(ice::service::event* operation, direction direction, bool& ready) noexcept
+  {
+#if ICE_OS_LINUX
+    if (!descriptor_) {
+      if (const auto ec = service_.attach(handle_, descriptor_)) {
+        return ec;
+      }
+    }
+    const auto slot = direction == direction::recv ? ice::service::descriptor::read : ice::service::descriptor::write;
+    ready = !descriptor_->wait(operation, slot);
+#elif ICE_OS_FREEBSD
+    struct kevent nev {};
+    const auto filter = direction == direction::recv ? EVFILT_READ : EVFILT_WRITE;
+    EV_SET(&nev, handle_.as<uintptr_t>(), filter, EV_ADD | EV_ONESHOT, 0, 0, operation);
+    if (::kevent(service_.handle(), &nev, 1, nullptr, 0, nullptr) < 0) {
+      return errno;
+    }
+#endif
+    return {};
+  }
+
+  ice::service& service_;
+  handle_type handle_;
+#if ICE_OS_LINUX
+  ice::service::descriptor* descriptor_ = nullptr;
+  multishot* multishot_ = nullptr;
+#endif
+};
+
+#endif
+
+}  // namespace ice::net
@@ -1,3 +1,542 @@
 #pragma once
+#include <ice/config.hpp>
+#include <ice/error.hpp>
+#include <ice/net/socket.hpp>
+#include <ice/service.hpp>
+#include <algorithm>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+#include <climits>
+#include <cstring>
 
-namespace ice::net::tcp {}
+#if !ICE_OS_WIN32
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <cerrno>
+#endif
+
+namespace ice::net::tcp {
+
+#if !ICE_OS_WIN32
+
+class socket : public ice::net::socket {
+#if ICE_URING_MULTISHOT
+  class multishot_recv;
+#endif
+
+public:
+  class connect_awaitable final : public operation {
+  public:
+    connect_awaitable(socket& socket, const ice::net::endpoint& endpoint) noexcept :
+      operation(socket, direction::send), endpoint_(endpoint)
+    {}
+
+    ice::error_code await_resume() const noexcept
+    {
+      return ec_;
+    }
+
+  private:
+    // Starts connecting on the first attempt and reads the result when the socket becomes writable.
+    bool attempt() noexcept override
+    {
+      if (started_) {
+        auto error = 0;
+        auto size = static_cast<socklen_t>(sizeof(error));
+        if (::getsockopt(socket_.handle(), SOL_SOCKET, SO_ERROR, &error, &size) < 0) {
+          error = errno;
+        }
+        if (error) {
+          ec_ = error;
+          return true;
+        }
+        // Notifications are not bound to a single operation, so the socket may still be connecting.
+        ice::net::endpoint endpoint;
+        auto endpoint_size = endpoint.capacity();
+        return ::getpeername(socket_.handle(), endpoint.data(), &endpoint_size) == 0 || errno != ENOTCONN;
+      }
+      started_ = true;
+      if (!open()) {
+        return true;
+      }
+      if (::connect(socket_.handle(), endpoint_.data(), endpoint_.size()) < 0) {
+        return errno != EINPROGRESS && complete(errno);
+      }
+      return true;
+    }
+
+#if ICE_OS_LINUX
+    bool start() noexcept override
+    {
+      return !open();
+    }
+
+    void prepare(io_uring_sqe& sqe) noexcept override
+    {
+      sqe.opcode = IORING_OP_CONNECT;
+      sqe.fd = socket_.handle();
+      sqe.addr = reinterpret_cast<std::uintptr_t>(endpoint_.data());
+      sqe.off = endpoint_.size();
+    }
+
+    bool finish(std::int32_t result) noexcept override
+    {
+      if (result < 0) {
+        ec_ = -result;
+      }
+      return true;
+    }
+#endif
+
+    // Creates the socket if necessary. Returns false on error.
+    bool open() noexcept
+    {
+      if (!socket_) {
+        if (const auto ec = socket_.create(endpoint_.family(), SOCK_STREAM, IPPROTO_TCP)) {
+          ec_ = ec;
+          return false;
+        }
+      }
+      return true;
+    }
+
+    const ice::net::endpoint& endpoint_;
+    bool started_ = false;
+  };
+
+  class recv_awaitable final : public operation {
+  public:
+    recv_awaitable(socket& socket, void* data, std::size_t size) noexcept :
+      operation(socket, direction::recv), data_(data), size_(size)
+    {}
+
+    // Returns the number of bytes received or ice::errc::eof when the connection was closed.
+    ice::net::io_result await_resume() const noexcept
+    {
+      return { received_, ec_ };
+    }
+
+  private:
+#if ICE_OS_LINUX
+#if ICE_URING_MULTISHOT
+    friend class multishot_recv;
+
+    // Takes data from the multishot receive operation of the socket when it is enabled.
+    bool suspend() noexcept override
+    {
+      auto& socket = static_cast<tcp::socket&>(socket_);
+      if (socket.multishot_) {
+        return socket.receiver().wait(*this);
+      }
+      return operation::suspend();
+    }
+#endif
+
+    void prepare(io_uring_sqe& sqe) noexcept override
+    {
+      sqe.opcode = IORING_OP_RECV;
+      sqe.fd = socket_.handle();
+      sqe.addr = reinterpret_cast<std::uintptr_t>(data_);
+      sqe.len = static_cast<std::uint32_t>(std::min(size_, std::size_t(INT_MAX)));
+    }
+
+    bool finish(std::int32_t result) noexcept override
+    {
+      if (result == -EAGAIN || result == -EINTR) {
+        return false;
+      }
+      if (result > 0) {
+        received_ = static_cast<std::size_t>(result);
+      } else if (result == 0) {
+        ec_ = ice::errc::eof;
+      } else {
+        ec_ = -result;
+      }
+      return true;
+    }
+#endif
+
+    bool attempt() noexcept override
+    {
+      while (true) {
+        const auto rc = ::recv(socket_.handle(), data_, size_, 0);
+        if (rc > 0) {
+          received_ = static_cast<std::size_t>(rc);
+          return true;
+        }
+        if (rc == 0) {
+          ec_ = ice::errc::eof;
+          return true;
+        }
+        if (errno != EINTR) {
+          return complete(errno);
+        }
+      }
+    }
+
+    void* const data_;
+    const std::size_t size_;
+    std::size_t received_ = 0;
+  };
+
+  class send_awaitable final : public operation {
+  public:
+    send_awaitable(socket& socket, const void* data, std::size_t size) noexcept :
+      operation(socket, direction::send), data_(static_cast<const char*>(data)), size_(size)
+    {}
+
+    // Returns the number of bytes sent, which is the requested size unless an error occurred.
+    ice::net::io_result await_resume() const noexcept
+    {
+      return { sent_, ec_ };
+    }
+
+  private:
+#if ICE_OS_LINUX
+    void prepare(io_uring_sqe& sqe) noexcept override
+    {
+      sqe.opcode = IORING_OP_SEND;
+      sqe.fd = socket_.handle();
+      sqe.addr = reinterpret_cast<std::uintptr_t>(data_ + sent_);
+      sqe.len = static_cast<std::uint32_t>(std::min(size_ - sent_, std::size_t(INT_MAX)));
+      sqe.msg_flags = MSG_NOSIGNAL;
+    }
+
+    // Submits the rest of the data again after a partial send.
+    bool finish(std::int32_t result) noexcept override
+    {
+      if (result == -EAGAIN || result == -EINTR) {
+        return false;
+      }
+      if (result < 0) {
+        ec_ = -result;
+        return true;
+      }
+      sent_ += static_cast<std::size_t>(result);
+      return sent_ == size_;
+    }
+#endif
+
+    bool attempt() noexcept override
+    {
+      while (sent_ < size_) {
+        const auto rc = ::send(socket_.handle(), data_ + sent_, size_ - sent_, MSG_NOSIGNAL);
+        if (rc >= 0) {
+          sent_ += static_cast<std::size_t>(rc);
+        } else if (errno != EINTR) {
+          return complete(errno);
+        }
+      }
+      return true;
+    }
+
+    const char* const data_;
+    const std::size_t size_;
+    std::size_t sent_ = 0;
+  };
+
+  using ice::net::socket::socket;
+
+  // Creates the socket if necessary and connects it. The endpoint must stay alive until the awaiter is resumed.
+  connect_awaitable connect(const ice::net::endpoint& endpoint) noexcept
+  {
+    return { *this, endpoint };
+  }
+
+  // Receives up to size bytes.
+  recv_awaitable recv(void* data, std::size_t size) noexcept
+  {
+    return { *this, data, size };
+  }
+
+  // Sends all bytes.
+  send_awaitable send(const void* data, std::size_t size) noexcept
+  {
+    return { *this, data, size };
+  }
+
+  ice::error_code shutdown(int how = SHUT_WR) noexcept
+  {
+    if (::shutdown(handle_, how) < 0) {
+      return errno;
+    }
+    return {};
+  }
+
+#if ICE_URING_MULTISHOT
+  // Receives with a multishot operation into buffers that the io_uring backend provides and copies the data into the
+  // buffers of receive operations, which saves a submission per receive on sockets that are read continuously. The
+  // provided buffers are shared by all sockets of the service and received data holds them until it is read, so this
+  // should only be enabled for sockets that are read promptly. Replacing the handle disables it again, so it must be
+  // enabled after the socket is connected or accepted. Disabling it completes a pending receive with ECANCELED.
+  void set_multishot(bool enable) noexcept
+  {
+    const auto ring = service_.uring();
+    if (enable && ring && ring->buffers()) {
+      receiver();
+    } else if (const auto multishot = std::exchange(multishot_, nullptr)) {
+      if (const auto waiter = multishot->orphan()) {
+        waiter->cancel();
+      }
+    }
+  }
+#endif
+
+private:
+  friend class acceptor;
+
+#if ICE_URING_MULTISHOT
+  // Receives into buffers provided by the service with a multishot operation and copies the data into the buffers of
+  // receive operations.
+  class multishot_recv final : public multishot {
+  public:
+    using multishot::multishot;
+
+    ~multishot_recv()
+    {
+      for (const auto& chunk : chunks_) {
+        service_.uring()->recycle(chunk.id);
+      }
+    }
+
+  private:
+    struct chunk {
+      std::uint16_t id = 0;
+      std::size_t size = 0;
+      std::size_t offset = 0;
+    };
+
+    void prepare(io_uring_sqe& sqe) noexcept override
+    {
+      sqe.opcode = IORING_OP_RECV;
+      sqe.fd = handle_;
+      sqe.ioprio = IORING_RECV_MULTISHOT;
+      sqe.flags = IOSQE_BUFFER_SELECT;
+      sqe.buf_group = ice::uring::buffer_group;
+    }
+
+    void push(std::int32_t result, std::uint32_t flags) noexcept override
+    {
+      if (flags & IORING_CQE_F_BUFFER) {
+        const auto id = static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (result > 0) {
+          chunks_.push_back({ id, static_cast<std::size_t>(result), 0 });
+        } else {
+          service_.uring()->recycle(id);
+        }
+      }
+      if (result == 0) {
+        eof_ = true;
+      }
+    }
+
+    bool take(operation& op, std::int32_t& result) noexcept override
+    {
+      auto& recv = static_cast<recv_awaitable&>(op);
+      if (chunks_.empty()) {
+        result = 0;
+        return eof_;
+      }
+      const auto data = static_cast<char*>(recv.data_);
+      const auto size = std::min(recv.size_, std::size_t(INT_MAX));
+      std::size_t received = 0;
+      while (!chunks_.empty() && received < size) {
+        auto& chunk = chunks_.front();
+        const auto count = std::min(chunk.size - chunk.offset, size - received);
+        std::memcpy(data + received, service_.uring()->buffer(chunk.id) + chunk.offset, count);
+        received += count;
+        chunk.offset += count;
+        if (chunk.offset == chunk.size) {
+          service_.uring()->recycle(chunk.id);
+          chunks_.pop_front();
+        }
+      }
+      result = static_cast<std::int32_t>(received);
+      return true;
+    }
+
+    void discard(std::int32_t result, std::uint32_t flags) noexcept override
+    {
+      if (flags & IORING_CQE_F_BUFFER) {
+        service_.uring()->recycle(static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT));
+      }
+    }
+
+    std::deque<chunk> chunks_;
+    bool eof_ = false;
+  };
+
+  multishot_recv& receiver() noexcept
+  {
+    if (!multishot_) {
+      multishot_ = new multishot_recv(*this);
+    }
+    return static_cast<multishot_recv&>(*multishot_);
+  }
+#endif
+};
+
+class acceptor : public ice::net::socket {
+public:
+  class accept_awaitable final : public operation {
+  public:
+    accept_awaitable(acceptor& acceptor, tcp::socket& client) noexcept :
+      operation(acceptor, direction::recv), client_(client)
+    {}
+
+    ice::error_code await_resume() const noexcept
+    {
+      return ec_;
+    }
+
+  private:
+#if ICE_OS_LINUX
+#if ICE_URING_MULTISHOT
+    // Takes a connection from the multishot accept operation of the acceptor.
+    bool suspend() noexcept override
+    {
+      if (socket_.service().uring()) {
+        return static_cast<acceptor&>(socket_).listener().wait(*this);
+      }
+      return operation::suspend();
+    }
+#endif
+
+    void prepare(io_uring_sqe& sqe) noexcept override
+    {
+      sqe.opcode = IORING_OP_ACCEPT;
+      sqe.fd = socket_.handle();
+      sqe.accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    }
+
+    bool finish(std::int32_t result) noexcept override
+    {
+      if (result == -EAGAIN || result == -EINTR || result == -ECONNABORTED) {
+        return false;
+      }
+      if (result < 0) {
+        ec_ = -result;
+        return true;
+      }
+      client_.reset(handle_type(result));
+      return true;
+    }
+#endif
+
+    bool attempt() noexcept override
+    {
+      while (true) {
+        handle_type handle(::accept4(socket_.handle(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC));
+        if (handle) {
+          client_.reset(std::move(handle));
+          return true;
+        }
+        if (errno != EINTR && errno != ECONNABORTED) {
+          return complete(errno);
+        }
+      }
+    }
+
+    tcp::socket& client_;
+  };
+
+  using ice::net::socket::socket;
+
+  // Creates the socket, binds it to the endpoint and starts listening. With reuse_port, acceptors on other services
+  // can listen on the same endpoint and the kernel distributes incoming connections between them.
+  ice::error_code listen(const ice::net::endpoint& endpoint, int backlog = SOMAXCONN, bool reuse_port = false) noexcept
+  {
+    if (const auto ec = create(endpoint.family(), SOCK_STREAM, IPPROTO_TCP)) {
+      return ec;
+    }
+    if (const auto ec = set(SOL_SOCKET, SO_REUSEADDR, 1)) {
+      return ec;
+    }
+    if (reuse_port) {
+#if ICE_OS_FREEBSD
+      const auto option = SO_REUSEPORT_LB;
+#else
+      const auto option = SO_REUSEPORT;
+#endif
+      if (const auto ec = set(SOL_SOCKET, option, 1)) {
+        return ec;
+      }
+    }
+    if (const auto ec = bind(endpoint)) {
+      return ec;
+    }
+    if (::listen(handle_, backlog) < 0) {
+      return errno;
+    }
+    return {};
+  }
+
+  // Accepts a connection into the client socket.
+  accept_awaitable accept(tcp::socket& client) noexcept
+  {
+    return { *this, client };
+  }
+
+private:
+#if ICE_URING_MULTISHOT
+  // Accepts connections with a multishot operation. Connections that arrive while no accept operation waits are queued.
+  class multishot_accept final : public multishot {
+  public:
+    using multishot::multishot;
+
+    ~multishot_accept()
+    {
+      for (const auto handle : handles_) {
+        ::close(handle);
+      }
+    }
+
+  private:
+    void prepare(io_uring_sqe& sqe) noexcept override
+    {
+      sqe.opcode = IORING_OP_ACCEPT;
+      sqe.fd = handle_;
+      sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+      sqe.accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    }
+
+    void push(std::int32_t result, std::uint32_t flags) noexcept override
+    {
+      handles_.push_back(result);
+    }
+
+    bool take(operation& op, std::int32_t& result) noexcept override
+    {
+      if (handles_.empty()) {
+        return false;
+      }
+      result = handles_.front();
+      handles_.pop_front();
+      return true;
+    }
+
+    void discard(std::int32_t result, std::uint32_t flags) noexcept override
+    {
+      if (result >= 0) {
+        ::close(result);
+      }
+    }
+
+    std::deque<int> handles_;
+  };
+
+  multishot_accept& listener() noexcept
+  {
+    if (!multishot_) {
+      multishot_ = new multishot_accept(*this);
+    }
+    return static_cast<multishot_accept&>(*multishot_);
+  }
+#endif
+};
+
+#endif
+
+}  // namespace ice::net::tcp
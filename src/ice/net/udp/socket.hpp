@@ -0,0 +1,228 @@
+#pragma once
+#include <ice/config.hpp>
+#include <ice/error.hpp>
+#include <ice/net/socket.hpp>
+#include <ice/service.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if !ICE_OS_WIN32
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <cerrno>
+#endif
+
+namespace ice::net::udp {
+
+#if !ICE_OS_WIN32
+
+// Buffer of a single datagram in a batch. On Linux, a buffer can also hold several datagrams of segment bytes each,
+// except for the last one, which can be shorter.
+struct message {
+  // Data to send or buffer to receive into.
+  void* data = nullptr;
+
+  // Number of bytes to send or the capacity of the buffer. Set to the number of bytes received.
+  std::size_t size = 0;
+
+  // Optional destination or source address.
+  ice::net::endpoint* endpoint = nullptr;
+
+  // Size of the datagrams to split the data into with UDP_SEGMENT or 0. Set to the size of the coalesced datagrams
+  // when the socket receives with UDP_GRO, or to 0 if the buffer holds a single datagram.
+  std::size_t segment = 0;
+
+  // Flags reported by the receive operation, for example MSG_TRUNC if the datagram did not fit into the buffer.
+  int flags = 0;
+};
+
+// Datagram socket that sends and receives batches of messages with one system call per batch. Receiving coalesced
+// datagrams is enabled with set(IPPROTO_UDP, UDP_GRO, 1) on Linux.
+class socket : public ice::net::socket {
+public:
+  // Maximum number of messages that are transferred with one system call.
+  constexpr static std::size_t batch_size = 64;
+
+  class batch_awaitable : public operation {
+  public:
+    batch_awaitable(socket& socket, direction direction, message* messages, std::size_t count) noexcept :
+      operation(socket, direction), messages_(messages), count_(count)
+    {}
+
+    // Returns the number of messages that were transferred.
+    ice::net::io_result await_resume() const noexcept
+    {
+      return { done_, ec_ };
+    }
+
+  protected:
+#if ICE_OS_LINUX
+    // Tries the system call first and waits for readiness with a poll operation on the io_uring backend.
+    bool start() noexcept override
+    {
+      return attempt();
+    }
+
+    void prepare(io_uring_sqe& sqe) noexcept override
+    {
+      sqe.opcode = IORING_OP_POLL_ADD;
+      sqe.fd = socket_.handle();
+      sqe.poll32_events = direction_ == direction::recv ? POLLIN : POLLOUT;
+    }
+
+    bool finish(std::int32_t result) noexcept override
+    {
+      if (result < 0) {
+        ec_ = -result;
+        return true;
+      }
+      return attempt();
+    }
+#endif
+
+    // Prepares the headers for the messages that were not transferred yet. Returns the number of headers.
+    unsigned fill() noexcept
+    {
+      const auto recv = direction_ == direction::recv;
+      const auto count = static_cast<unsigned>(std::min(count_ - done_, batch_size));
+      for (unsigned i = 0; i < count; i++) {
+        auto& message = messages_[done_ + i];
+        auto& header = headers_[i].msg_hdr;
+        vectors_[i].iov_base = message.data;
+        vectors_[i].iov_len = message.size;
+        header = {};
+        header.msg_iov = &vectors_[i];
+        header.msg_iovlen = 1;
+        if (message.endpoint) {
+          header.msg_name = message.endpoint->data();
+          header.msg_namelen = recv ? message.endpoint->capacity() : message.endpoint->size();
+        }
+#if ICE_OS_LINUX
+        if (recv) {
+          header.msg_control = control_[i];
+          header.msg_controllen = sizeof(control_[i]);
+        } else if (message.segment) {
+          header.msg_control = control_[i];
+          header.msg_controllen = CMSG_SPACE(sizeof(std::uint16_t));
+          const auto cmsg = CMSG_FIRSTHDR(&header);
+          cmsg->cmsg_level = IPPROTO_UDP;
+          cmsg->cmsg_type = UDP_SEGMENT;
+          cmsg->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+          const auto segment = static_cast<std::uint16_t>(message.segment);
+          std::memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+        }
+#endif
+      }
+      return count;
+    }
+
+    message* const messages_;
+    const std::size_t count_;
+    std::size_t done_ = 0;
+    mmsghdr headers_[batch_size];
+    iovec vectors_[batch_size];
+#if ICE_OS_LINUX
+    alignas(cmsghdr) unsigned char control_[batch_size][CMSG_SPACE(sizeof(int))];
+#endif
+  };
+
+  class recv_awaitable final : public batch_awaitable {
+  public:
+    recv_awaitable(socket& socket, message* messages, std::size_t count) noexcept :
+      batch_awaitable(socket, direction::recv, messages, count)
+    {}
+
+  private:
+    bool attempt() noexcept override
+    {
+      if (!count_) {
+        return true;
+      }
+      const auto count = fill();
+      while (true) {
+        const auto rc = ::recvmmsg(socket_.handle(), headers_, count, 0, nullptr);
+        if (rc >= 0) {
+          done_ = static_cast<std::size_t>(rc);
+          break;
+        }
+        if (errno != EINTR) {
+          return complete(errno);
+        }
+      }
+      for (std::size_t i = 0; i < done_; i++) {
+        auto& message = messages_[i];
+        auto& header = headers_[i].msg_hdr;
+        message.size = headers_[i].msg_len;
+        message.flags = header.msg_flags;
+        message.segment = 0;
+        if (message.endpoint) {
+          message.endpoint->resize(header.msg_namelen);
+        }
+#if ICE_OS_LINUX
+        for (auto cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(&header, cmsg)) {
+          if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+            auto segment = 0;
+            std::memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+            message.segment = static_cast<std::size_t>(segment);
+          }
+        }
+#endif
+      }
+      return true;
+    }
+  };
+
+  class send_awaitable final : public batch_awaitable {
+  public:
+    send_awaitable(socket& socket, message* messages, std::size_t count) noexcept :
+      batch_awaitable(socket, direction::send, messages, count)
+    {}
+
+  private:
+    bool attempt() noexcept override
+    {
+      while (done_ < count_) {
+        const auto rc = ::sendmmsg(socket_.handle(), headers_, fill(), MSG_NOSIGNAL);
+        if (rc >= 0) {
+          done_ += static_cast<std::size_t>(rc);
+        } else if (errno != EINTR) {
+          return complete(errno);
+        }
+      }
+      return true;
+    }
+  };
+
+  using ice::net::socket::socket;
+
+  // Creates the socket and binds it to the endpoint.
+  ice::error_code open(const ice::net::endpoint& endpoint) noexcept
+  {
+    if (const auto ec = create(endpoint.family(), SOCK_DGRAM, IPPROTO_UDP)) {
+      return ec;
+    }
+    return bind(endpoint);
+  }
+
+  // Receives at least one and up to batch_size messages. Updates the size, segment, flags and endpoint of the received
+  // messages. The messages must stay alive until the awaiter is resumed.
+  recv_awaitable recv(message* messages, std::size_t count) noexcept
+  {
+    return { *this, messages, count };
+  }
+
+  // Sends all messages in batches of up to batch_size. The messages must stay alive until the awaiter is resumed.
+  send_awaitable send(message* messages, std::size_t count) noexcept
+  {
+    return { *this, messages, count };
+  }
+};
+
+#endif
+
+}  // namespace ice::net::udp
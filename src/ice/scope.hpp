@@ -0,0 +1,140 @@
+#pragma once
+#include <ice/config.hpp>
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <atomic>
+#include <experimental/coroutine>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+#include <cstddef>
+
+#if ICE_EXCEPTIONS
+#include <exception>
+#endif
+
+namespace ice {
+
+// Tracks detached work so that it can be awaited before shutdown. Spawned awaitables (usually lazy ice::task objects)
+// are started immediately and counted until they complete. An optional limit rejects new work while the given number
+// of awaitables is in flight. The first exception is rethrown by join.
+class async_scope {
+public:
+  class join_awaitable {
+  public:
+    join_awaitable(async_scope& scope) noexcept : scope_(scope) {}
+
+    constexpr bool await_ready() const noexcept
+    {
+      return false;
+    }
+
+    // Clears the idle bit unless nothing is in flight. The last awaitable sets it again before posting the awaiter.
+    bool await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+    {
+      scope_.continuation_.suspend(awaiter);
+      auto state = scope_.state_.load(std::memory_order_acquire);
+      do {
+        if (state == idle) {
+          return false;
+        }
+      } while (!scope_.state_.compare_exchange_weak(state, state - idle, std::memory_order_acq_rel));
+      return true;
+    }
+
+    void await_resume() noexcept(ICE_NO_EXCEPTIONS)
+    {
+#if ICE_EXCEPTIONS
+      scope_.failed_.clear(std::memory_order_relaxed);
+      if (scope_.exception_) {
+        std::rethrow_exception(std::exchange(scope_.exception_, nullptr));
+      }
+#endif
+    }
+
+  private:
+    async_scope& scope_;
+  };
+
+  // A limit of zero does not restrict the number of awaitables in flight.
+  explicit async_scope(std::size_t limit = 0) noexcept : limit_(limit) {}
+
+  async_scope(const async_scope& other) = delete;
+  async_scope& operator=(const async_scope& other) = delete;
+
+  ~async_scope()
+  {
+    assert(state_.load(std::memory_order_acquire) == idle);
+  }
+
+  // Starts the awaitable unless the limit is reached.
+  template <typename Awaitable>
+  bool spawn(Awaitable&& awaitable) noexcept(ICE_NO_EXCEPTIONS)
+  {
+    auto state = state_.load(std::memory_order_relaxed);
+    do {
+      if (limit_ && state / unit >= limit_) {
+        return false;
+      }
+    } while (!state_.compare_exchange_weak(state, state + unit, std::memory_order_relaxed));
+    run<std::decay_t<Awaitable>>(*this, std::forward<Awaitable>(awaitable));
+    return true;
+  }
+
+  // Returns the number of awaitables in flight.
+  std::size_t size() const noexcept
+  {
+    return state_.load(std::memory_order_relaxed) / unit;
+  }
+
+  // Waits for all awaitables to complete. Must not be awaited by more than one coroutine at a time.
+  join_awaitable join() noexcept
+  {
+    return { *this };
+  }
+
+private:
+  template <typename Awaitable>
+  static ice::detached run(async_scope& scope, Awaitable awaitable)
+  {
+#if ICE_EXCEPTIONS
+    try {
+      co_await std::move(awaitable);
+    }
+    catch (...) {
+      if (!scope.failed_.test_and_set(std::memory_order_relaxed)) {
+        scope.exception_ = std::current_exception();
+      }
+    }
+#else
+    co_await std::move(awaitable);
+#endif
+    scope.release();
+  }
+
+  // The last awaitable in flight sets the idle bit in the same step, so that work spawned after it cannot post the
+  // awaiter of join a second time.
+  void release() noexcept
+  {
+    auto state = state_.load(std::memory_order_relaxed);
+    while (!state_.compare_exchange_weak(state, state == unit ? idle : state - unit, std::memory_order_acq_rel)) {
+    }
+    if (state == unit) {
+      continuation_.post();
+    }
+  }
+
+  // Number of awaitables in flight times unit plus the idle bit, which is cleared while join is pending.
+  constexpr static std::size_t idle = 1;
+  constexpr static std::size_t unit = 2;
+
+  std::atomic_size_t state_ = idle;
+  const std::size_t limit_ = 0;
+  ice::continuation continuation_;
+#if ICE_EXCEPTIONS
+  std::atomic_flag failed_ = ATOMIC_FLAG_INIT;
+  std::exception_ptr exception_;
+#endif
+};
+
+}  // namespace ice
@@ -1,9 +1,19 @@
 #pragma once
 #include <ice/config.hpp>
+#include <ice/context.hpp>
 #include <ice/handle.hpp>
+#include <ice/uring.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <experimental/coroutine>
+#include <memory>
+#include <mutex>
 #include <utility>
 #include <vector>
+#include <climits>
+#include <cstdint>
 
 #if ICE_OS_WIN32
 #include <windows.h>
@@ -12,6 +22,8 @@
 #if ICE_OS_LINUX
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <cerrno>
 #elif ICE_OS_FREEBSD
 #include <sys/event.h>
 #endif
@@ -70,17 +82,181 @@ public:
 
 #else
   struct close_type {
-    void operator()(HANDLE handle) noexcept
+    void operator()(int handle) noexcept
     {
       ::close(handle);
     }
   };
 
   using handle_type = ice::handle<int, -1, close_type>;
+
+  class event {
+  public:
+    event() noexcept = default;
+
+    event(event&& other) = delete;
+    event& operator=(event&& other) = delete;
+
+    event(const event& other) = delete;
+    event& operator=(const event& other) = delete;
+
+    virtual ~event() = default;
+
+    bool await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+    {
+      awaiter_ = awaiter;
+      return suspend();
+    }
+
+    void await_resume() noexcept
+    {
+      if (resume() || !suspend()) {
+        awaiter_.resume();
+      }
+    }
+
+    virtual bool suspend() noexcept = 0;
+    virtual bool resume() noexcept = 0;
+
+  protected:
+    friend class service;
+
+    std::experimental::coroutine_handle<> awaiter_;
+    std::int32_t result_ = 0;
+    std::uint32_t flags_ = 0;
+  };
+#endif
+
+#if ICE_OS_LINUX
+  enum class backend_type {
+    epoll,
+    uring,
+    uring_sqpoll,
+  };
+
+  // Receives every completion of a multishot io_uring submission.
+  class completion {
+  public:
+    virtual ~completion() = default;
+    virtual void complete(std::int32_t result, std::uint32_t flags) noexcept = 0;
+  };
+
+  // Handle that is registered once with edge-triggered epoll notifications for both directions. Every direction has a
+  // slot for one waiting event, so that a reader and a writer can wait at the same time without modifying the
+  // registration. Descriptors are owned by the service and reused, so that notifications which are still queued when
+  // a descriptor is released only cause a spurious retry.
+  class descriptor {
+  public:
+    constexpr static std::size_t read = 0;
+    constexpr static std::size_t write = 1;
+
+    descriptor() noexcept = default;
+
+    descriptor(const descriptor& other) = delete;
+    descriptor& operator=(const descriptor& other) = delete;
+
+    // Registers the event as the waiter for the direction. Returns false without registering it if the handle became
+    // ready since the waiter was last resumed, in which case the operation should be attempted again.
+    bool wait(event* ev, std::size_t direction) noexcept
+    {
+      auto& slot = slots_[direction];
+      auto value = slot.load(std::memory_order_acquire);
+      while (true) {
+        if (value == notified) {
+          if (slot.compare_exchange_weak(value, idle, std::memory_order_acq_rel)) {
+            return false;
+          }
+        } else if (slot.compare_exchange_weak(value, reinterpret_cast<std::uintptr_t>(ev), std::memory_order_acq_rel)) {
+          return true;
+        }
+      }
+    }
+
+    // Removes the waiter for the direction and returns it. Returns nullptr if no event waits or a notification already
+    // resumes it.
+    event* take(std::size_t direction) noexcept
+    {
+      const auto value = slots_[direction].exchange(idle, std::memory_order_acq_rel);
+      if (value == idle || value == notified) {
+        return nullptr;
+      }
+      return reinterpret_cast<event*>(value);
+    }
+
+  private:
+    friend class service;
+
+    constexpr static std::uintptr_t idle = 0;
+    constexpr static std::uintptr_t notified = 1;
+
+    void notify(std::uint32_t events) noexcept
+    {
+      if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        notify(read);
+      }
+      if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+        notify(write);
+      }
+    }
+
+    // Resumes the waiter or remembers the notification for the next wait.
+    void notify(std::size_t direction) noexcept
+    {
+      auto& slot = slots_[direction];
+      auto value = slot.load(std::memory_order_acquire);
+      do {
+        if (value == notified) {
+          return;
+        }
+      } while (!slot.compare_exchange_weak(value, value == idle ? notified : idle, std::memory_order_acq_rel));
+      if (value != idle) {
+        reinterpret_cast<event*>(value)->await_resume();
+      }
+    }
+
+    std::atomic_uintptr_t slots_[2] = {};
+    descriptor* next_ = nullptr;
+  };
 #endif
 
   service() noexcept = default;
 
+  service(service&& other) noexcept = default;
+  service& operator=(service&& other) noexcept = default;
+
+  service(const service& other) = delete;
+  service& operator=(const service& other) = delete;
+
+  ~service()
+  {
+#if ICE_OS_LINUX
+    if (uring_) {
+      drain();
+    }
+#endif
+  }
+
+#if ICE_OS_LINUX
+  // Creates the service with the requested backend. The io_uring backends report events on completion like IOCP does
+  // on Windows. Falls back to io_uring without SQPOLL and then to epoll when the kernel does not support them.
+  ice::error_code create(backend_type backend, std::uint32_t entries = 1024) noexcept
+  {
+    if (backend != backend_type::epoll) {
+      auto ring = std::make_unique<ice::uring>();
+      auto ec = ring->create(entries, backend == backend_type::uring_sqpoll);
+      if (ec && backend == backend_type::uring_sqpoll) {
+        ring = std::make_unique<ice::uring>();
+        ec = ring->create(entries, false);
+      }
+      if (!ec) {
+        uring_ = std::move(ring);
+        return {};
+      }
+    }
+    return create();
+  }
+#endif
+
   ice::error_code create() noexcept
   {
 #if ICE_OS_WIN32
@@ -120,15 +296,27 @@ public:
     if (::epoll_ctl(handle, EPOLL_CTL_ADD, events, &nev) < 0) {
       return errno;
     }
+    handle_type wakeup(::eventfd(0, EFD_NONBLOCK));
+    if (!wakeup) {
+      return errno;
+    }
+    epoll_event wev = { EPOLLIN | EPOLLET, {} };
+    wev.data.u64 = wakeup_key;
+    if (::epoll_ctl(handle, EPOLL_CTL_ADD, wakeup, &wev) < 0) {
+      return errno;
+    }
     events_ = std::move(events);
+    wakeup_ = std::move(wakeup);
+    descriptors_ = std::make_unique<descriptors>();
 #elif ICE_OS_FREEBSD
     handle_type handle(::kqueue());
     if (!handle) {
       return errno;
     }
-    struct kevent nev = {};
-    EV_SET(&nev, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
-    if (::kevent(handle, &nev, 1, nullptr, 0, nullptr) < 0) {
+    struct kevent nev[2] = {};
+    EV_SET(&nev[0], 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+    EV_SET(&nev[1], 1, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, reinterpret_cast<void*>(wakeup_key));
+    if (::kevent(handle, nev, 2, nullptr, 0, nullptr) < 0) {
       return errno;
     }
 #endif
@@ -138,6 +326,146 @@ public:
 
   ice::error_code run(std::size_t event_buffer_size = 128) noexcept(ICE_NO_EXCEPTIONS)
   {
+    return run(nullptr, event_buffer_size);
+  }
+
+  // Runs the service and the context on the calling thread. Events scheduled on the context are resumed between
+  // service event batches without a thread switch. Returns when the service or the context is stopped. Fails if the
+  // context is already run by as many threads as its concurrency allows.
+  ice::error_code run(ice::context& context, std::size_t event_buffer_size = 128) noexcept(ICE_NO_EXCEPTIONS)
+  {
+    ice::context::loop loop(context, wake, this);
+    if (!loop) {
+      return std::errc::device_or_resource_busy;
+    }
+    return run(&loop, event_buffer_size);
+  }
+
+  void stop() noexcept
+  {
+#if ICE_OS_LINUX
+    if (uring_) {
+      uring_->submit([](io_uring_sqe& sqe) { sqe.opcode = IORING_OP_NOP; });
+      return;
+    }
+#endif
+#if ICE_OS_WIN32
+    ::PostQueuedCompletionStatus(handle_, 0, 0, nullptr);
+#elif ICE_OS_LINUX
+    epoll_event nev{ EPOLLOUT | EPOLLONESHOT, {} };
+    ::epoll_ctl(handle_, EPOLL_CTL_MOD, events_, &nev);
+#elif ICE_OS_FREEBSD
+    struct kevent nev {};
+    EV_SET(&nev, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+    ::kevent(handle_, &nev, 1, nullptr, 0, nullptr);
+#endif
+  }
+
+  constexpr handle_type::value_type handle() const noexcept
+  {
+    return handle_;
+  }
+
+#if ICE_OS_LINUX
+  constexpr handle_type::value_type events() const noexcept
+  {
+    return events_;
+  }
+
+  backend_type backend() const noexcept
+  {
+    if (!uring_) {
+      return backend_type::epoll;
+    }
+    return uring_->sqpoll() ? backend_type::uring_sqpoll : backend_type::uring;
+  }
+
+  // Returns the io_uring instance or nullptr when the service uses epoll.
+  ice::uring* uring() const noexcept
+  {
+    return uring_.get();
+  }
+
+  // Registers the handle with edge-triggered notifications for both directions. The descriptor must be released before
+  // the handle is closed.
+  ice::error_code attach(handle_type::value_type handle, descriptor*& result) noexcept
+  {
+    {
+      std::lock_guard lock(descriptors_->mutex);
+      if (const auto free = descriptors_->free) {
+        descriptors_->free = free->next_;
+        result = free;
+      } else {
+        result = &descriptors_->storage.emplace_back();
+      }
+    }
+    epoll_event nev = { EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, {} };
+    nev.data.u64 = reinterpret_cast<std::uintptr_t>(result) | 1;
+    if (::epoll_ctl(handle_, EPOLL_CTL_ADD, handle, &nev) < 0) {
+      const auto ec = errno;
+      release(std::exchange(result, nullptr));
+      return ec;
+    }
+    return {};
+  }
+
+  // Returns the descriptor to the service for reuse.
+  void release(descriptor* descriptor) noexcept
+  {
+    for (auto& slot : descriptor->slots_) {
+      slot.store(descriptor::idle, std::memory_order_relaxed);
+    }
+    std::lock_guard lock(descriptors_->mutex);
+    descriptor->next_ = descriptors_->free;
+    descriptors_->free = descriptor;
+  }
+
+  // Submits an operation that resumes the event when it completes.
+  template <typename Prepare>
+  ice::error_code submit(event& ev, Prepare&& prepare) noexcept
+  {
+    return uring_->submit([&](io_uring_sqe& sqe) {
+      prepare(sqe);
+      sqe.user_data = reinterpret_cast<std::uintptr_t>(&ev);
+    });
+  }
+
+  // Submits a multishot operation that reports each completion to the handler.
+  template <typename Prepare>
+  ice::error_code submit(completion& handler, Prepare&& prepare) noexcept
+  {
+    return uring_->submit([&](io_uring_sqe& sqe) {
+      prepare(sqe);
+      sqe.user_data = reinterpret_cast<std::uintptr_t>(&handler) | 1;
+    });
+  }
+
+  // Closes the handle after cancelling its pending operations, which complete with ECANCELED. Operations submitted to
+  // io_uring hold a reference to the file and would not complete if the handle was only closed. On the epoll backend or
+  // when the cancellation cannot be submitted, the handle is closed directly.
+  void close(handle_type handle) noexcept
+  {
+    if (uring_ && !uring_->close(handle, wakeup_key)) {
+      handle.release();
+    }
+  }
+
+  // Cancels a multishot operation. The handler receives a final completion without IORING_CQE_F_MORE, which is
+  // delivered by the service destructor if the service no longer runs.
+  ice::error_code cancel(completion& handler) noexcept
+  {
+    return uring_->cancel(reinterpret_cast<std::uintptr_t>(&handler) | 1, wakeup_key);
+  }
+#endif
+
+private:
+  ice::error_code run(ice::context::loop* loop, std::size_t event_buffer_size) noexcept(ICE_NO_EXCEPTIONS)
+  {
+#if ICE_OS_LINUX
+    if (uring_) {
+      return run(*uring_, loop, event_buffer_size);
+    }
+#endif
 #if ICE_OS_WIN32
     using data_type = OVERLAPPED_ENTRY;
     using size_type = ULONG;
@@ -155,24 +483,73 @@ public:
 
     const auto events_data = events.data();
     const auto events_size = static_cast<size_type>(events.size());
+#if ICE_OS_LINUX
+    auto pwait2 = true;
+#endif
 
     while (true) {
+      auto timeout = std::chrono::nanoseconds::max();
+      if (loop && !loop->poll(timeout)) {
+        break;
+      }
+      const auto infinite = timeout == std::chrono::nanoseconds::max();
 #if ICE_OS_WIN32
+      DWORD wait = INFINITE;
+      if (!infinite) {
+        const auto ms = std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+        wait = static_cast<DWORD>(std::min<long long>(ms, INFINITE - 1));
+      }
       size_type count = 0;
-      if (!::GetQueuedCompletionStatusEx(handle_, events_data, events_size, &count, INFINITE, FALSE)) {
-        if (const auto rc = ::GetLastError(); rc != ERROR_ABANDONED_WAIT_0) {
+      if (!::GetQueuedCompletionStatusEx(handle_, events_data, events_size, &count, wait, FALSE)) {
+        const auto rc = ::GetLastError();
+        if (rc == WAIT_TIMEOUT) {
+          continue;
+        }
+        if (rc != ERROR_ABANDONED_WAIT_0) {
           ec = rc;
         }
         break;
       }
 #elif ICE_OS_LINUX
-      const auto count = ::epoll_wait(handle_, events_data, events_size, -1);
+      // Timers of an attached context need a nanosecond timeout. Kernels before 5.11 lack epoll_pwait2 and fall back
+      // to epoll_wait, which rounds the timeout up to whole milliseconds.
+      auto count = -1;
+#ifdef SYS_epoll_pwait2
+      if (pwait2) {
+        timespec ts = {};
+        if (!infinite) {
+          const auto s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+          ts.tv_sec = static_cast<decltype(ts.tv_sec)>(s.count());
+          ts.tv_nsec = static_cast<decltype(ts.tv_nsec)>((timeout - s).count());
+        }
+        const auto rc = ::syscall(SYS_epoll_pwait2, handle_.value(), events_data, events_size, infinite ? nullptr : &ts,
+          nullptr, 0);
+        count = static_cast<int>(rc);
+        pwait2 = count >= 0 || (errno != ENOSYS && errno != EPERM);
+      }
+#else
+      pwait2 = false;
+#endif
+      if (!pwait2) {
+        auto wait = -1;
+        if (!infinite) {
+          const auto ms = std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+          wait = static_cast<int>(std::min<long long>(ms, INT_MAX));
+        }
+        count = ::epoll_wait(handle_, events_data, events_size, wait);
+      }
       if (count < 0 && errno != EINTR) {
         ec = errno;
         break;
       }
 #elif ICE_OS_FREEBSD
-      const auto count = ::kevent(handle_, nullptr, 0, events_data, events_size, nullptr);
+      timespec ts = {};
+      if (!infinite) {
+        const auto s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        ts.tv_sec = static_cast<decltype(ts.tv_sec)>(s.count());
+        ts.tv_nsec = static_cast<decltype(ts.tv_nsec)>((timeout - s).count());
+      }
+      const auto count = ::kevent(handle_, nullptr, 0, events_data, events_size, infinite ? nullptr : &ts);
       if (count < 0 && errno != EINTR) {
         ec = errno;
         break;
@@ -186,12 +563,27 @@ public:
           ev->await_resume();
           continue;
         }
+        if (entry.lpCompletionKey == wakeup_key) {
+          continue;
+        }
 #elif ICE_OS_LINUX
+        if (entry.data.u64 == wakeup_key) {
+          std::uint64_t value = 0;
+          [[maybe_unused]] const auto rv = ::read(wakeup_, &value, sizeof(value));
+          continue;
+        }
+        if (entry.data.u64 & 1) {
+          reinterpret_cast<descriptor*>(entry.data.u64 & ~std::uint64_t(1))->notify(entry.events);
+          continue;
+        }
         if (const auto ev = reinterpret_cast<event*>(entry.data.ptr)) {
           ev->await_resume();
           continue;
         }
 #elif ICE_OS_FREEBSD
+        if (reinterpret_cast<std::uintptr_t>(entry.udata) == wakeup_key) {
+          continue;
+        }
         if (const auto ev = reinterpret_cast<event*>(entry.udata)) {
           ev->await_resume();
           continue;
@@ -206,36 +598,133 @@ public:
     return ec;
   }
 
-  void stop() noexcept
+#if ICE_OS_LINUX
+  ice::error_code run(ice::uring& ring, ice::context::loop* loop, std::size_t event_buffer_size) noexcept(
+    ICE_NO_EXCEPTIONS)
   {
-#if ICE_OS_WIN32
-    ::PostQueuedCompletionStatus(handle_, 0, 0, nullptr);
-#elif ICE_OS_LINUX
-    epoll_event nev{ EPOLLOUT | EPOLLONESHOT, {} };
-    ::epoll_ctl(handle_, EPOLL_CTL_MOD, events_, &nev);
-#elif ICE_OS_FREEBSD
-    struct kevent nev {};
-    EV_SET(&nev, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
-    ::kevent(handle_, &nev, 1, nullptr, 0, nullptr);
-#endif
+    ice::error_code ec;
+    std::vector<io_uring_cqe> events;
+    events.resize(event_buffer_size);
+
+    ice::uring::scope scope(ring);
+    while (true) {
+      auto timeout = std::chrono::nanoseconds::max();
+      if (loop && !loop->poll(timeout)) {
+        break;
+      }
+      if (const auto rc = ring.wait(timeout)) {
+        ec = rc;
+        break;
+      }
+      bool interrupted = false;
+      const auto count = ring.reap(events.data(), events.size());
+      for (std::size_t i = 0; i < count; i++) {
+        if (!dispatch(events[i], true)) {
+          interrupted = true;
+        }
+      }
+      if (interrupted) {
+        break;
+      }
+    }
+    return ec;
   }
 
-  constexpr handle_type::value_type handle() const noexcept
+  // Handles a completion. Returns false for the completion that stops the run loop.
+  bool dispatch(const io_uring_cqe& entry, bool resume) noexcept
   {
-    return handle_;
+    const auto data = static_cast<std::uintptr_t>(entry.user_data);
+    if (data == wakeup_key) {
+      return true;
+    }
+    if (data & 1) {
+      if (!(entry.flags & IORING_CQE_F_MORE)) {
+        uring_->release(data);
+      }
+      reinterpret_cast<completion*>(data & ~std::uintptr_t(1))->complete(entry.res, entry.flags);
+      return true;
+    }
+    if (const auto ev = reinterpret_cast<event*>(data)) {
+      if (resume) {
+        ev->result_ = entry.res;
+        ev->flags_ = entry.flags;
+        ev->await_resume();
+      }
+      return true;
+    }
+    return false;
   }
 
-#if ICE_OS_LINUX
-  constexpr handle_type::value_type events() const noexcept
+  // Waits for the final completions of cancelled multishot operations so that their handlers can release themselves.
+  // The kernel can deliver them asynchronously after the run loop returned. Pending events are not resumed because the
+  // service is going away.
+  void drain() noexcept
   {
-    return events_;
+    io_uring_cqe entries[64];
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (true) {
+      const auto count = uring_->reap(entries, std::size(entries));
+      for (std::size_t i = 0; i < count; i++) {
+        dispatch(entries[i], false);
+      }
+      if (count) {
+        continue;
+      }
+      const auto timeout = deadline - std::chrono::steady_clock::now();
+      if (!uring_->cancelling() || timeout <= timeout.zero()) {
+        break;
+      }
+      uring_->wait(timeout);
+    }
   }
 #endif
 
-private:
+  // Interrupts a blocked run loop so that it can resume events scheduled on the attached context.
+  static void wake(void* data) noexcept
+  {
+    const auto self = static_cast<service*>(data);
+#if ICE_OS_LINUX
+    if (self->uring_) {
+      self->uring_->submit([](io_uring_sqe& sqe) {
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = wakeup_key;
+      });
+      return;
+    }
+#endif
+#if ICE_OS_WIN32
+    ::PostQueuedCompletionStatus(self->handle_, 0, wakeup_key, nullptr);
+#elif ICE_OS_LINUX
+    const std::uint64_t value = 1;
+    [[maybe_unused]] const auto rv = ::write(self->wakeup_, &value, sizeof(value));
+#elif ICE_OS_FREEBSD
+    struct kevent nev {};
+    EV_SET(&nev, 1, EVFILT_USER, 0, NOTE_TRIGGER, 0, reinterpret_cast<void*>(wakeup_key));
+    ::kevent(self->handle_, &nev, 1, nullptr, 0, nullptr);
+#endif
+  }
+
+  // Identifies wakeup notifications. Registrations do not use the address of the service because it is movable. On
+  // other systems, the value is not a valid event address and has the lowest bit clear, which tags descriptors and
+  // multishot completions.
+#if ICE_OS_WIN32
+  constexpr static ULONG_PTR wakeup_key = 1;
+#else
+  constexpr static std::uintptr_t wakeup_key = 2;
+#endif
+
   handle_type handle_;
 #if ICE_OS_LINUX
+  struct descriptors {
+    std::mutex mutex;
+    std::deque<descriptor> storage;
+    descriptor* free = nullptr;
+  };
+
   handle_type events_;
+  handle_type wakeup_;
+  std::unique_ptr<descriptors> descriptors_;
+  std::unique_ptr<ice::uring> uring_;
 #endif
 };
 
@@ -0,0 +1,139 @@
+#pragma once
+#include <ice/config.hpp>
+#include <ice/context.hpp>
+#include <ice/service.hpp>
+#include <ice/utility.hpp>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+
+namespace ice {
+
+// Owns a set of shards that each consist of a service and a context and are run by a thread pinned to a separate
+// logical processor. Every shard has its own reactor, so run loops never share an event handle. Operations on sockets
+// of a shard's service are resumed by the shard's thread, which keeps the coroutines that use them on the shard.
+// Listening sockets can be bound to the same endpoint on every shard with SO_REUSEPORT to let the kernel spread
+// incoming connections.
+class service_pool {
+public:
+  class shard {
+  public:
+    ice::service& service() noexcept
+    {
+      return service_;
+    }
+
+    ice::context& context() noexcept
+    {
+      return context_;
+    }
+
+  private:
+    friend class service_pool;
+
+    ice::service service_;
+    ice::context context_;
+  };
+
+  service_pool() noexcept = default;
+
+  service_pool(const service_pool& other) = delete;
+  service_pool& operator=(const service_pool& other) = delete;
+
+  ~service_pool()
+  {
+    stop();
+    join();
+  }
+
+  // Starts one shard per physical core or the given number of shards on consecutive logical processors.
+  ice::error_code create(std::size_t size = 0) noexcept(ICE_NO_EXCEPTIONS)
+  {
+    return create(size, [](ice::service& service) { return service.create(); });
+  }
+
+#if ICE_OS_LINUX
+  // Starts the shards with the requested service backend.
+  ice::error_code create(std::size_t size, ice::service::backend_type backend) noexcept(ICE_NO_EXCEPTIONS)
+  {
+    return create(size, [backend](ice::service& service) { return service.create(backend); });
+  }
+#endif
+
+  void stop() noexcept
+  {
+    for (std::size_t i = 0; i < size_; i++) {
+      shards_[i].service_.stop();
+    }
+  }
+
+  void join() noexcept
+  {
+    for (auto& thread : threads_) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+  }
+
+  std::size_t size() const noexcept
+  {
+    return size_;
+  }
+
+  shard& operator[](std::size_t index) noexcept
+  {
+    assert(index < size_);
+    return shards_[index];
+  }
+
+  // Selects the shards in turn.
+  shard& next() noexcept
+  {
+    assert(size_);
+    return shards_[index_.fetch_add(1, std::memory_order_relaxed) % size_];
+  }
+
+private:
+  template <typename Create>
+  ice::error_code create(std::size_t size, Create create) noexcept(ICE_NO_EXCEPTIONS)
+  {
+    assert(!size_);
+    auto cores = ice::physical_cores();
+    if (size) {
+      const auto concurrency = std::max(std::thread::hardware_concurrency(), 1u);
+      cores.resize(size);
+      for (std::size_t i = 0; i < size; i++) {
+        cores[i] = i % concurrency;
+      }
+    }
+    auto shards = std::make_unique<shard[]>(cores.size());
+    for (std::size_t i = 0; i < cores.size(); i++) {
+      if (const auto ec = create(shards[i].service_)) {
+        return ec;
+      }
+    }
+    shards_ = std::move(shards);
+    size_ = cores.size();
+    threads_.reserve(size_);
+    ice::error_code ec;
+    for (std::size_t i = 0; i < size_; i++) {
+      threads_.emplace_back([this, i]() { shards_[i].service_.run(shards_[i].context_); });
+      if (const auto rc = ice::set_thread_affinity(threads_.back(), cores[i]); rc && !ec) {
+        ec = rc;
+      }
+    }
+    return ec;
+  }
+
+  std::unique_ptr<shard[]> shards_;
+  std::size_t size_ = 0;
+  std::vector<std::thread> threads_;
+  alignas(64) std::atomic_uint32_t index_ = 0;
+};
+
+}  // namespace ice
@@ -0,0 +1,449 @@
+#pragma once
+#include <ice/config.hpp>
+#include <ice/error.hpp>
+#include <ice/handle.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#if ICE_OS_LINUX
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#endif
+
+// Provided buffer rings and multishot operations require kernel headers from Linux 6.0 or newer.
+#ifndef ICE_URING_MULTISHOT
+#if ICE_OS_LINUX && defined(IORING_RECV_MULTISHOT)
+#define ICE_URING_MULTISHOT 1
+#else
+#define ICE_URING_MULTISHOT 0
+#endif
+#endif
+
+namespace ice {
+
+#if ICE_OS_LINUX
+
+// Submission and completion queues of an io_uring instance and a ring of provided receive buffers.
+//
+// Submissions are serialized by a lock. Threads that wait for completions defer their own submissions until the next
+// wait call, so that a batch of operations started by resumed coroutines costs a single system call. Other threads
+// submit right away. With SQPOLL, a kernel thread picks up submissions and system calls are only made to wake it up.
+class uring {
+public:
+  struct close_type {
+    void operator()(int handle) noexcept
+    {
+      ::close(handle);
+    }
+  };
+
+  using handle_type = ice::handle<int, -1, close_type>;
+
+  // Marks the calling thread as a thread that waits for completions of the ring.
+  class scope {
+  public:
+    explicit scope(ice::uring& ring) noexcept : ring_(ring), previous_(std::exchange(current_, &ring)) {}
+
+    scope(const scope& other) = delete;
+    scope& operator=(const scope& other) = delete;
+
+    ~scope()
+    {
+      current_ = previous_;
+      ring_.flush();
+    }
+
+  private:
+    ice::uring& ring_;
+    ice::uring* const previous_;
+  };
+
+  constexpr static std::uint16_t buffer_group = 0;
+  constexpr static std::uint32_t buffer_count = 64;
+  constexpr static std::uint32_t buffer_size = 16 * 1024;
+
+  uring() noexcept = default;
+
+  uring(uring&& other) = delete;
+  uring& operator=(uring&& other) = delete;
+
+  uring(const uring& other) = delete;
+  uring& operator=(const uring& other) = delete;
+
+  ~uring()
+  {
+#if ICE_URING_MULTISHOT
+    if (buffers_) {
+      ::munmap(buffers_, buffers_size());
+    }
+#endif
+    if (sqes_) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (ring_) {
+      ::munmap(ring_, ring_size_);
+    }
+  }
+
+  // Creates the queues. Fails with ENOSYS when the kernel lacks features that the service relies on, in which case
+  // the caller is expected to fall back to another backend.
+  ice::error_code create(std::uint32_t entries, bool sqpoll) noexcept
+  {
+    io_uring_params params = {};
+    if (sqpoll) {
+      params.flags |= IORING_SETUP_SQPOLL;
+      params.sq_thread_idle = 100;
+    }
+    handle_type handle(static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params)));
+    if (!handle) {
+      return errno;
+    }
+    constexpr auto required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_SUBMIT_STABLE |
+      IORING_FEAT_FAST_POLL | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required) {
+      return ENOSYS;
+    }
+    if (sqpoll) {
+#ifdef IORING_FEAT_SQPOLL_NONFIXED
+      if (!(params.features & IORING_FEAT_SQPOLL_NONFIXED)) {
+        return ENOSYS;
+      }
+#else
+      return ENOSYS;
+#endif
+    }
+
+    ring_size_ = std::max(
+      params.sq_off.array + params.sq_entries * sizeof(std::uint32_t),
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    ring_ = map(ring_size_, handle, IORING_OFF_SQ_RING);
+    if (!ring_) {
+      return errno;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, handle, IORING_OFF_SQES));
+    if (!sqes_) {
+      return errno;
+    }
+    const auto ring = static_cast<char*>(ring_);
+    sq_head_ = reinterpret_cast<std::uint32_t*>(ring + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<std::uint32_t*>(ring + params.sq_off.tail);
+    sq_flags_ = reinterpret_cast<std::uint32_t*>(ring + params.sq_off.flags);
+    sq_mask_ = *reinterpret_cast<std::uint32_t*>(ring + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    cq_head_ = reinterpret_cast<std::uint32_t*>(ring + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<std::uint32_t*>(ring + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<std::uint32_t*>(ring + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+    const auto array = reinterpret_cast<std::uint32_t*>(ring + params.sq_off.array);
+    for (std::uint32_t i = 0; i < params.sq_entries; i++) {
+      array[i] = i;
+    }
+
+#if ICE_URING_MULTISHOT
+    // Provided buffers are optional. Multishot receive operations are not used without them.
+    buffers_ = map(buffers_size(), -1, 0);
+    if (buffers_) {
+      io_uring_buf_reg reg = {};
+      reg.ring_addr = reinterpret_cast<std::uintptr_t>(buffers_);
+      reg.ring_entries = buffer_count;
+      reg.bgid = buffer_group;
+      if (::syscall(__NR_io_uring_register, handle.value(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        ::munmap(buffers_, buffers_size());
+        buffers_ = nullptr;
+      } else {
+        for (std::uint16_t id = 0; id < buffer_count; id++) {
+          recycle(id);
+        }
+      }
+    }
+#endif
+    sqpoll_ = sqpoll;
+    handle_ = std::move(handle);
+    return {};
+  }
+
+  // Adds a submission queue entry that is filled in by prepare(io_uring_sqe&) and submits it unless the calling thread
+  // waits for completions of this ring.
+  template <typename Prepare>
+  ice::error_code submit(Prepare&& prepare) noexcept
+  {
+    std::lock_guard lock(sq_mutex_);
+    while (sq_tail() - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+      if (const auto ec = enter(sq_entries_, 0, sqpoll_ ? IORING_ENTER_SQ_WAIT : 0)) {
+        return ec;
+      }
+    }
+    const auto tail = sq_tail();
+    auto& sqe = sqes_[tail & sq_mask_];
+    sqe = {};
+    prepare(sqe);
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    if (current_ == this) {
+      return {};
+    }
+    return submit();
+  }
+
+  // Submits deferred entries.
+  ice::error_code flush() noexcept
+  {
+    std::lock_guard lock(sq_mutex_);
+    return submit();
+  }
+
+  // Submits deferred entries and waits until a completion is available or the timeout expires.
+  ice::error_code wait(std::chrono::nanoseconds timeout) noexcept
+  {
+    std::uint32_t pending = 0;
+    std::uint32_t flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    {
+      std::lock_guard lock(sq_mutex_);
+      if (sqpoll_) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+          flags |= IORING_ENTER_SQ_WAKEUP;
+        }
+      } else {
+        pending = sq_tail() - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+      }
+    }
+    if (!pending && !(flags & IORING_ENTER_SQ_WAKEUP) && ready()) {
+      return {};
+    }
+    __kernel_timespec ts = {};
+    io_uring_getevents_arg arg = {};
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout != std::chrono::nanoseconds::max()) {
+      const auto s = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+      ts.tv_sec = s.count();
+      ts.tv_nsec = (timeout - s).count();
+      arg.ts = reinterpret_cast<std::uintptr_t>(&ts);
+    }
+    if (::syscall(__NR_io_uring_enter, handle_.value(), pending, 1, flags, &arg, sizeof(arg)) < 0) {
+      switch (errno) {
+      case ETIME:
+      case EINTR:
+      case EAGAIN:
+      case EBUSY: break;
+      default: return errno;
+      }
+    }
+    return {};
+  }
+
+  // Copies up to size completion queue entries and returns the number of copied entries.
+  std::size_t reap(io_uring_cqe* entries, std::size_t size) noexcept
+  {
+    std::lock_guard lock(cq_mutex_);
+    const auto head = *cq_head_;
+    const auto tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    const auto count = std::min(static_cast<std::size_t>(tail - head), size);
+    for (std::size_t i = 0; i < count; i++) {
+      entries[i] = cqes_[(head + static_cast<std::uint32_t>(i)) & cq_mask_];
+    }
+    __atomic_store_n(cq_head_, head + static_cast<std::uint32_t>(count), __ATOMIC_RELEASE);
+    return count;
+  }
+
+  // Cancels the operation with the target user data. The operation is tracked as cancelled until it is released after
+  // its final completion.
+  ice::error_code cancel(std::uint64_t target, std::uint64_t user_data) noexcept
+  {
+    {
+      std::lock_guard lock(cancel_mutex_);
+      cancelled_.push_back(target);
+    }
+    return submit([&](io_uring_sqe& sqe) {
+      sqe.opcode = IORING_OP_ASYNC_CANCEL;
+      sqe.fd = -1;
+      sqe.addr = target;
+      sqe.user_data = user_data;
+    });
+  }
+
+  // Cancels all operations on the file descriptor and closes it once they were cancelled. The cancelled operations
+  // complete with ECANCELED. Returns an error if the file descriptor was not queued to be closed.
+  ice::error_code close(int fd, std::uint64_t user_data) noexcept
+  {
+#ifdef IORING_ASYNC_CANCEL_FD
+    std::lock_guard lock(sq_mutex_);
+    while (sq_entries_ - (sq_tail() - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)) < 2) {
+      if (const auto ec = enter(sq_entries_, 0, sqpoll_ ? IORING_ENTER_SQ_WAIT : 0)) {
+        return ec;
+      }
+    }
+    const auto tail = sq_tail();
+    auto& cancel = sqes_[tail & sq_mask_];
+    cancel = {};
+    cancel.opcode = IORING_OP_ASYNC_CANCEL;
+    cancel.flags = IOSQE_IO_HARDLINK;
+    cancel.fd = fd;
+    cancel.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    cancel.user_data = user_data;
+    auto& close = sqes_[(tail + 1) & sq_mask_];
+    close = {};
+    close.opcode = IORING_OP_CLOSE;
+    close.fd = fd;
+    close.user_data = user_data;
+    __atomic_store_n(sq_tail_, tail + 2, __ATOMIC_RELEASE);
+    if (current_ != this) {
+      // The entries are submitted with the next wait if this fails.
+      submit();
+    }
+    return {};
+#else
+    return ENOSYS;
+#endif
+  }
+
+  // Stops tracking a cancelled operation.
+  void release(std::uint64_t target) noexcept
+  {
+    std::lock_guard lock(cancel_mutex_);
+    if (const auto it = std::find(cancelled_.begin(), cancelled_.end(), target); it != cancelled_.end()) {
+      cancelled_.erase(it);
+    }
+  }
+
+  // Returns true if cancelled operations have not been released yet.
+  bool cancelling() noexcept
+  {
+    std::lock_guard lock(cancel_mutex_);
+    return !cancelled_.empty();
+  }
+
+  // Returns true if provided buffers are available for multishot receive operations.
+  bool buffers() const noexcept
+  {
+    return buffers_ != nullptr;
+  }
+
+#if ICE_URING_MULTISHOT
+  char* buffer(std::uint16_t id) const noexcept
+  {
+    return static_cast<char*>(buffers_) + buffer_count * sizeof(io_uring_buf) + std::size_t(id) * buffer_size;
+  }
+
+  // Returns a buffer that was selected by a completed receive operation to the kernel.
+  void recycle(std::uint16_t id) noexcept
+  {
+    std::lock_guard lock(buffers_mutex_);
+    const auto ring = static_cast<io_uring_buf_ring*>(buffers_);
+    auto& entry = ring->bufs[buffers_tail_ & (buffer_count - 1)];
+    entry.addr = reinterpret_cast<std::uintptr_t>(buffer(id));
+    entry.len = buffer_size;
+    entry.bid = id;
+    __atomic_store_n(&ring->tail, ++buffers_tail_, __ATOMIC_RELEASE);
+  }
+#endif
+
+  bool sqpoll() const noexcept
+  {
+    return sqpoll_;
+  }
+
+  constexpr handle_type::value_type handle() const noexcept
+  {
+    return handle_;
+  }
+
+private:
+  static void* map(std::size_t size, int handle, off_t offset) noexcept
+  {
+    const auto flags = handle < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED | MAP_POPULATE;
+    const auto data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, handle, offset);
+    return data == MAP_FAILED ? nullptr : data;
+  }
+
+#if ICE_URING_MULTISHOT
+  static constexpr std::size_t buffers_size() noexcept
+  {
+    return buffer_count * (sizeof(io_uring_buf) + buffer_size);
+  }
+#endif
+
+  std::uint32_t sq_tail() const noexcept
+  {
+    return *sq_tail_;
+  }
+
+  // Returns true if the completion queue is not empty and has not overflown.
+  bool ready() const noexcept
+  {
+    if (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW) {
+      return false;
+    }
+    return __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) != *cq_head_;
+  }
+
+  // Submits entries that the kernel has not consumed yet. Must be called with the submission lock held.
+  ice::error_code submit() noexcept
+  {
+    if (sqpoll_) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+        return enter(0, 0, IORING_ENTER_SQ_WAKEUP);
+      }
+      return {};
+    }
+    if (const auto pending = sq_tail() - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)) {
+      return enter(pending, 0, 0);
+    }
+    return {};
+  }
+
+  ice::error_code enter(std::uint32_t submit, std::uint32_t wait, std::uint32_t flags) noexcept
+  {
+    while (::syscall(__NR_io_uring_enter, handle_.value(), submit, wait, flags, nullptr, 0) < 0) {
+      if (errno != EINTR) {
+        return errno;
+      }
+    }
+    return {};
+  }
+
+  static inline thread_local uring* current_ = nullptr;
+
+  handle_type handle_;
+  bool sqpoll_ = false;
+
+  void* ring_ = nullptr;
+  std::size_t ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  std::size_t sqes_size_ = 0;
+
+  std::mutex sq_mutex_;
+  std::uint32_t* sq_head_ = nullptr;
+  std::uint32_t* sq_tail_ = nullptr;
+  std::uint32_t* sq_flags_ = nullptr;
+  std::uint32_t sq_mask_ = 0;
+  std::uint32_t sq_entries_ = 0;
+
+  std::mutex cq_mutex_;
+  std::uint32_t* cq_head_ = nullptr;
+  std::uint32_t* cq_tail_ = nullptr;
+  std::uint32_t cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+
+  std::mutex cancel_mutex_;
+  std::vector<std::uint64_t> cancelled_;
+
+  std::mutex buffers_mutex_;
+  void* buffers_ = nullptr;
+  std::uint16_t buffers_tail_ = 0;
+};
+
+#endif
+
+}  // namespace ice
@@ -1,16 +1,22 @@
 #pragma once
 #include <ice/config.hpp>
 #include <ice/handle.hpp>
+#include <algorithm>
+#include <memory>
 #include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
 #include <cassert>
+#include <cstdio>
 
 #if ICE_OS_WIN32
 #include <windows.h>
 #else
 #include <pthread.h>
 #if ICE_OS_FREEBSD
+#include <sys/types.h>
+#include <sys/sysctl.h>
 #include <pthread_np.h>
 #endif
 #endif
@@ -156,6 +162,62 @@ inline ice::error_code set_thread_affinity(std::thread& thread, std::size_t inde
   return {};
 }
 
+// Returns the index of the first logical processor of every physical core.
+inline std::vector<std::size_t> physical_cores() noexcept(ICE_NO_EXCEPTIONS)
+{
+  std::vector<std::size_t> cores;
+  const auto size = std::max(std::thread::hardware_concurrency(), 1u);
+#if ICE_OS_WIN32
+  DWORD bytes = 0;
+  ::GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &bytes);
+  auto buffer = std::make_unique<char[]>(bytes);
+  auto data = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.get());
+  if (bytes && ::GetLogicalProcessorInformationEx(RelationProcessorCore, data, &bytes)) {
+    for (DWORD offset = 0; offset < bytes;) {
+      const auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.get() + offset);
+      if (const auto mask = info->Processor.GroupMask[0].Mask; mask && info->Processor.GroupMask[0].Group == 0) {
+        std::size_t index = 0;
+        while (!(mask & (KAFFINITY(1) << index))) {
+          index++;
+        }
+        cores.push_back(index);
+      }
+      offset += info->Size;
+    }
+  }
+#elif ICE_OS_LINUX
+  for (std::size_t i = 0; i < size; i++) {
+    char path[128];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/topology/thread_siblings_list", i);
+    std::size_t first = i;
+    if (const auto file = std::fopen(path, "r")) {
+      if (std::fscanf(file, "%zu", &first) != 1) {
+        first = i;
+      }
+      std::fclose(file);
+    }
+    if (first == i) {
+      cores.push_back(i);
+    }
+  }
+#elif ICE_OS_FREEBSD
+  int threads = 1;
+  auto threads_size = sizeof(threads);
+  if (::sysctlbyname("kern.smp.threads_per_core", &threads, &threads_size, nullptr, 0) < 0 || threads < 1) {
+    threads = 1;
+  }
+  for (std::size_t i = 0; i < size; i += static_cast<std::size_t>(threads)) {
+    cores.push_back(i);
+  }
+#endif
+  if (cores.empty()) {
+    for (std::size_t i = 0; i < size; i++) {
+      cores.push_back(i);
+    }
+  }
+  return cores;
+}
+
 template <typename Handler>
 class scope_exit {
 public:
@@ -0,0 +1,209 @@
+#pragma once
+#include <ice/config.hpp>
+#include <ice/async.hpp>
+#include <atomic>
+#include <experimental/coroutine>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cassert>
+
+namespace ice {
+
+// Starts tasks and resumes the awaiter on the thread that completes the last one.
+// The results are read with task::get or by awaiting the tasks afterwards, which does not suspend.
+template <typename Start>
+class when_all_awaitable final : public ice::join {
+public:
+  when_all_awaitable(std::size_t size, Start start) noexcept : size_(size), start_(std::move(start)) {}
+
+  when_all_awaitable(when_all_awaitable&& other) = delete;
+  when_all_awaitable& operator=(when_all_awaitable&& other) = delete;
+
+  bool await_ready() const noexcept
+  {
+    return size_ == 0;
+  }
+
+  // The extra count keeps a task that completes while the others are started from resuming the awaiter.
+  std::experimental::coroutine_handle<> await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+  {
+    awaiter_ = awaiter;
+    count_.store(size_ + 1, std::memory_order_relaxed);
+    start_(*this);
+    return complete();
+  }
+
+  constexpr void await_resume() const noexcept {}
+
+  std::experimental::coroutine_handle<> complete() noexcept override
+  {
+    if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      return awaiter_;
+    }
+    return std::experimental::noop_coroutine();
+  }
+
+private:
+  const std::size_t size_;
+  Start start_;
+  std::experimental::coroutine_handle<> awaiter_;
+  std::atomic_size_t count_ = 0;
+};
+
+// Awaits all tasks. The tasks must not have been started.
+template <typename... Tasks>
+auto when_all(Tasks&... tasks) noexcept
+{
+  auto start = [&tasks...](ice::join& join) noexcept { (tasks.start(join), ...); };
+  return ice::when_all_awaitable<decltype(start)>{ sizeof...(tasks), start };
+}
+
+// Awaits all tasks in a range. The tasks must not have been started.
+template <typename Range, typename = decltype(std::begin(std::declval<Range&>()))>
+auto when_all(Range& tasks) noexcept
+{
+  auto start = [&tasks](ice::join& join) noexcept {
+    for (auto& task : tasks) {
+      task.start(join);
+    }
+  };
+  return ice::when_all_awaitable<decltype(start)>{ static_cast<std::size_t>(std::size(tasks)), start };
+}
+
+// Starts tasks and resumes the awaiter on the thread that completes the first one. Returns the index of the first
+// task and its result unless it is void. The other tasks keep running and are destroyed when the last one completes.
+template <typename T, typename Allocator>
+class when_any_awaitable {
+public:
+  using task_type = ice::task<T, Allocator>;
+
+  when_any_awaitable(std::vector<task_type> tasks) noexcept(ICE_NO_EXCEPTIONS) : state_(new state(std::move(tasks)))
+  {
+    assert(!state_->tasks.empty());
+  }
+
+  when_any_awaitable(when_any_awaitable&& other) noexcept : state_(std::exchange(other.state_, nullptr)) {}
+
+  when_any_awaitable(const when_any_awaitable& other) = delete;
+  when_any_awaitable& operator=(const when_any_awaitable& other) = delete;
+
+  ~when_any_awaitable()
+  {
+    if (state_) {
+      state_->release();
+    }
+  }
+
+  constexpr bool await_ready() const noexcept
+  {
+    return false;
+  }
+
+  std::experimental::coroutine_handle<> await_suspend(std::experimental::coroutine_handle<> awaiter) noexcept
+  {
+    const auto size = state_->tasks.size();
+    state_->awaiter = awaiter;
+    state_->references.fetch_add(size, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < size; i++) {
+      state_->tasks[i].start(state_->children[i]);
+    }
+    return state_->resume();
+  }
+
+  auto await_resume() noexcept(ICE_NO_EXCEPTIONS)
+  {
+    const auto index = state_->index;
+    if constexpr (std::is_void_v<T>) {
+      state_->tasks[index].get();
+      return index;
+    } else {
+      return std::pair<std::size_t, T>{ index, std::move(state_->tasks[index]).get() };
+    }
+  }
+
+private:
+  struct state;
+
+  struct child final : ice::join {
+    child(state* owner, std::size_t index) noexcept : owner_(owner), index_(index) {}
+
+    std::experimental::coroutine_handle<> complete() noexcept override
+    {
+      return owner_->complete(index_);
+    }
+
+    state* owner_;
+    std::size_t index_;
+  };
+
+  // Owned by the awaitable and by the tasks that did not complete yet.
+  struct state {
+    state(std::vector<task_type> tasks) noexcept(ICE_NO_EXCEPTIONS) : tasks(std::move(tasks))
+    {
+      children.reserve(this->tasks.size());
+      for (std::size_t i = 0; i < this->tasks.size(); i++) {
+        children.emplace_back(this, i);
+      }
+    }
+
+    // Called by the first task that completes and after all tasks are started.
+    std::experimental::coroutine_handle<> resume() noexcept
+    {
+      if (gate.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        return awaiter;
+      }
+      return std::experimental::noop_coroutine();
+    }
+
+    std::experimental::coroutine_handle<> complete(std::size_t index) noexcept
+    {
+      std::experimental::coroutine_handle<> next = std::experimental::noop_coroutine();
+      if (!done.exchange(true, std::memory_order_acq_rel)) {
+        this->index = index;
+        next = resume();
+      }
+      release();
+      return next;
+    }
+
+    void release() noexcept
+    {
+      if (references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+      }
+    }
+
+    std::vector<task_type> tasks;
+    std::vector<child> children;
+    std::experimental::coroutine_handle<> awaiter;
+    std::atomic_size_t references = 1;
+    std::atomic_size_t gate = 2;
+    std::atomic_bool done = false;
+    std::size_t index = 0;
+  };
+
+  state* state_ = nullptr;
+};
+
+// Awaits the first of the tasks to complete. The tasks must not have been started.
+template <typename T, typename Allocator>
+auto when_any(std::vector<ice::task<T, Allocator>> tasks) noexcept(ICE_NO_EXCEPTIONS)
+{
+  return ice::when_any_awaitable<T, Allocator>{ std::move(tasks) };
+}
+
+template <typename T, typename Allocator, typename... Tasks>
+auto when_any(ice::task<T, Allocator> task, Tasks... tasks) noexcept(ICE_NO_EXCEPTIONS)
+{
+  static_assert((std::is_same_v<ice::task<T, Allocator>, Tasks> && ...), "tasks must have the same type");
+  std::vector<ice::task<T, Allocator>> range;
+  range.reserve(sizeof...(tasks) + 1);
+  range.push_back(std::move(task));
+  (range.push_back(std::move(tasks)), ...);
+  return ice::when_any_awaitable<T, Allocator>{ std::move(range) };
+}
+
+}  // namespace ice
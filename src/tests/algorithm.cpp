@@ -0,0 +1,60 @@
+#include <ice/algorithm.hpp>
+#include <ice/async.hpp>
+#include <ice/context_pool.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Verifies that chunks cover the range exactly once, start large and are at least grain indices long.
+TEST(algorithm, range)
+{
+  ice::parallel_range range{ 1000, 4, 10 };
+  std::vector<std::size_t> sizes;
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  std::size_t expected = 0;
+  while (range.next(begin, end)) {
+    EXPECT_EQ(begin, expected);
+    sizes.push_back(end - begin);
+    expected = end;
+  }
+  EXPECT_EQ(expected, 1000u);
+  EXPECT_EQ(sizes.front(), 125u);
+  EXPECT_TRUE(std::is_sorted(sizes.rbegin(), sizes.rend()));
+  EXPECT_TRUE(std::all_of(sizes.begin(), sizes.end() - 1, [](std::size_t size) { return size >= 10; }));
+}
+
+// Verifies the algorithms on a pool of contexts.
+TEST(algorithm, pool)
+{
+  ice::context_pool pool;
+  pool.create(4);
+  std::vector<int> values(100000);
+  std::iota(values.begin(), values.end(), 0);
+  std::shuffle(values.begin(), values.end(), std::mt19937{ 0 });
+  auto co = [&]() -> ice::sync<void> {
+    std::vector<std::atomic_int> visits(values.size());
+    co_await ice::parallel_for(pool, values.begin(), values.end(), [&](int value) { visits[value].fetch_add(1); });
+    EXPECT_TRUE(std::all_of(visits.begin(), visits.end(), [](const std::atomic_int& v) { return v.load() == 1; }));
+
+    const auto widen = [](int value) { return std::int64_t(value); };
+    const auto sum = co_await ice::transform_reduce(pool, values.begin(), values.end(), std::int64_t(0), std::plus<>{},
+      widen);
+    EXPECT_EQ(sum, std::int64_t(values.size()) * (std::int64_t(values.size()) - 1) / 2);
+
+    std::vector<int> empty;
+    EXPECT_EQ(co_await ice::transform_reduce(pool, empty.begin(), empty.end(), 7, std::plus<>{}, std::negate<>{}), 7);
+    co_await ice::parallel_for(pool, empty.begin(), empty.end(), [](int) { ADD_FAILURE(); });
+
+    auto expected = values;
+    std::sort(expected.begin(), expected.end(), std::greater<>{});
+    co_await ice::sort(pool, values.begin(), values.end(), std::greater<>{});
+    EXPECT_EQ(values, expected);
+  };
+  co().get();
+}
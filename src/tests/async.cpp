@@ -0,0 +1,192 @@
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <ice/frame.hpp>
+#include <ice/when.hpp>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Verifies that threads blocked on a completion are woken up when it is set.
+TEST(async, completion)
+{
+  ice::completion completion;
+  std::atomic_size_t count = 0;
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < 4; i++) {
+    threads.emplace_back([&]() {
+      completion.wait();
+      count.fetch_add(1);
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(count.load(), 0u);
+  completion.set();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(count.load(), 4u);
+  completion.wait();
+}
+
+// Verifies that a task does not start before it is awaited.
+TEST(async, lazy)
+{
+  bool started = false;
+  auto value = [&]() -> ice::task<int> {
+    started = true;
+    co_return 1;
+  };
+  auto co = [&]() -> ice::sync<int> {
+    auto task = value();
+    EXPECT_FALSE(started);
+    const auto result = co_await task;
+    EXPECT_TRUE(started);
+    co_return result;
+  };
+  EXPECT_EQ(co().get(), 1);
+}
+
+// Verifies that tasks can be chained and return move-only values.
+TEST(async, chain)
+{
+  constexpr int depth = 1000;
+
+  struct recurse {
+    static ice::task<int> call(int depth) noexcept
+    {
+      if (depth == 0) {
+        co_return 0;
+      }
+      co_return co_await call(depth - 1) + 1;
+    }
+  };
+  auto pointer = []() -> ice::task<std::unique_ptr<int>> {
+    co_return std::make_unique<int>(1);
+  };
+  auto empty = [](int& count) -> ice::task<> {
+    count++;
+    co_return;
+  };
+  auto co = [&]() -> ice::sync<void> {
+    EXPECT_EQ(co_await recurse::call(depth), depth);
+    const auto value = co_await pointer();
+    EXPECT_EQ(*value, 1);
+    int count = 0;
+    for (int i = 0; i < depth; i++) {
+      co_await empty(count);
+    }
+    EXPECT_EQ(count, depth);
+  };
+  co().get();
+}
+
+// Verifies that a task resumes its awaiter on the context the task completed on.
+TEST(async, context)
+{
+  ice::context c0;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto hop = [&]() -> ice::task<std::thread::id> {
+    co_await ice::schedule(c0, true);
+    co_return std::this_thread::get_id();
+  };
+  auto co = [&]() -> ice::sync<void> {
+    EXPECT_EQ(co_await hop(), t0.get_id());
+    EXPECT_TRUE(c0.is_current());
+    c0.stop();
+  };
+  co().get();
+  t0.join();
+}
+
+// Verifies that pooled coroutine frames are reused by the thread that freed them.
+TEST(async, frame)
+{
+  const auto frame = ice::frame_pool::allocate(100);
+  ice::frame_pool::deallocate(frame, 128);
+  EXPECT_EQ(ice::frame_pool::allocate(65), frame);
+  ice::frame_pool::deallocate(frame, 100);
+
+  ice::context c0;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto value = [&](int i) -> ice::task<int, ice::frame_pool> {
+    co_await ice::schedule(c0, true);
+    co_return i;
+  };
+  auto co = [&]() -> ice::sync<int, ice::frame_pool> {
+    int sum = 0;
+    for (int i = 0; i < 1000; i++) {
+      sum += co_await value(i);
+    }
+    c0.stop();
+    co_return sum;
+  };
+  EXPECT_EQ(co().get(), 499500);
+  t0.join();
+}
+
+// Verifies that when_all resumes the awaiter after all tasks completed on different contexts.
+TEST(async, when_all)
+{
+  ice::context c0;
+  ice::context c1;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto t1 = std::thread([&]() { c1.run(); });
+  auto value = [&](ice::context& context, int i) -> ice::task<int> {
+    co_await ice::schedule(context, true);
+    co_return i;
+  };
+  auto empty = [&](ice::context& context) -> ice::task<> {
+    co_await ice::schedule(context, true);
+  };
+  auto co = [&]() -> ice::sync<void> {
+    co_await ice::when_all();
+    auto a = value(c0, 1);
+    auto b = empty(c1);
+    co_await ice::when_all(a, b);
+    EXPECT_TRUE(a.done());
+    EXPECT_TRUE(b.done());
+    EXPECT_EQ(co_await a, 1);
+
+    std::vector<ice::task<int>> tasks;
+    for (int i = 0; i < 1000; i++) {
+      tasks.push_back(value(i % 2 ? c0 : c1, i));
+    }
+    co_await ice::when_all(tasks);
+    int sum = 0;
+    for (auto& task : tasks) {
+      sum += task.get();
+    }
+    EXPECT_EQ(sum, 499500);
+    c0.stop();
+    c1.stop();
+  };
+  co().get();
+  t0.join();
+  t1.join();
+}
+
+// Verifies that when_any resumes the awaiter after the first task completed.
+TEST(async, when_any)
+{
+  ice::context c0;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto value = [&](int i, std::chrono::milliseconds duration) -> ice::task<int> {
+    co_await ice::sleep_for(c0, duration);
+    co_return i;
+  };
+  auto co = [&]() -> ice::sync<void> {
+    const auto [index, result] = co_await ice::when_any(
+      value(0, std::chrono::milliseconds(50)), value(1, std::chrono::milliseconds(1)),
+      value(2, std::chrono::milliseconds(100)));
+    EXPECT_EQ(index, 1u);
+    EXPECT_EQ(result, 1);
+    EXPECT_TRUE(c0.is_current());
+  };
+  co().get();
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  c0.stop();
+  t0.join();
+}
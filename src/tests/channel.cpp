@@ -0,0 +1,76 @@
+#include <ice/async.hpp>
+#include <ice/channel.hpp>
+#include <ice/context.hpp>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Verifies that values are moved through the channel in order and that a full or empty channel is detected.
+TEST(channel, try)
+{
+  ice::channel<std::unique_ptr<int>> channel{ 3 };
+  EXPECT_FALSE(channel.try_receive());
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(channel.try_send(std::make_unique<int>(i)));
+  }
+  auto value = std::make_unique<int>(3);
+  EXPECT_FALSE(channel.try_send(value));
+  EXPECT_TRUE(value);
+  for (int i = 0; i < 3; i++) {
+    const auto received = channel.try_receive();
+    ASSERT_TRUE(received);
+    EXPECT_EQ(**received, i);
+  }
+  EXPECT_FALSE(channel.try_receive());
+}
+
+// Verifies that senders and receivers on different contexts are suspended and resumed on their own context.
+TEST(channel, context)
+{
+  constexpr std::size_t senders = 4;
+  constexpr std::size_t receivers = 4;
+  constexpr std::size_t size = 10000;
+
+  ice::context c0;
+  ice::context c1;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto t1 = std::thread([&]() { c1.run(); });
+  ice::channel<std::unique_ptr<std::size_t>> channel{ 4 };
+  std::atomic_size_t sum = 0;
+  std::atomic_size_t count = 0;
+  auto send = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    for (std::size_t i = 0; i < size; i++) {
+      co_await channel.send(std::make_unique<std::size_t>(i));
+      EXPECT_TRUE(c0.is_current());
+    }
+  };
+  auto receive = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c1, true);
+    for (std::size_t i = 0; i < size; i++) {
+      const auto value = co_await channel.receive();
+      EXPECT_TRUE(c1.is_current());
+      sum.fetch_add(*value);
+      count.fetch_add(1);
+    }
+  };
+  std::vector<ice::sync<void>> tasks;
+  for (std::size_t i = 0; i < receivers; i++) {
+    tasks.push_back(receive());
+  }
+  for (std::size_t i = 0; i < senders; i++) {
+    tasks.push_back(send());
+  }
+  for (auto& task : tasks) {
+    task.get();
+  }
+  EXPECT_EQ(count.load(), senders * size);
+  EXPECT_EQ(sum.load(), senders * size * (size - 1) / 2);
+  EXPECT_FALSE(channel.try_receive());
+  c0.stop();
+  c1.stop();
+  t0.join();
+  t1.join();
+}
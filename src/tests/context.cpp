@@ -1,7 +1,12 @@
 #include <ice/async.hpp>
 #include <ice/context.hpp>
+#include <ice/context_pool.hpp>
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <optional>
 #include <thread>
+#include <vector>
 
 // Verifies that the schedule operation works.
 TEST(context, schedule)
@@ -45,3 +50,358 @@ TEST(context, schedule)
   t1.join();
   co.get();
 }
+
+// Verifies that multiple threads can run the same context.
+TEST(context, concurrency)
+{
+  constexpr std::size_t threads = 4;
+  constexpr std::size_t tasks = 1000;
+  constexpr std::size_t switches = 10;
+
+  ice::context c0{ threads };
+  std::vector<std::thread> pool;
+  for (std::size_t i = 0; i < threads; i++) {
+    pool.emplace_back([&]() { c0.run(); });
+  }
+
+  std::atomic_size_t count = 0;
+  auto co = [&]() -> ice::detached {
+    for (std::size_t i = 0; i < switches; i++) {
+      co_await ice::schedule(c0, true);
+      EXPECT_TRUE(c0.is_current());
+    }
+    if (count.fetch_add(1) + 1 == tasks) {
+      c0.stop();
+    }
+  };
+  for (std::size_t i = 0; i < tasks; i++) {
+    co();
+  }
+
+  for (auto& thread : pool) {
+    thread.join();
+  }
+  EXPECT_EQ(count.load(), tasks);
+}
+
+// Verifies that events are resumed in the order they were scheduled.
+TEST(context, order)
+{
+  constexpr std::size_t tasks = 1000;
+
+  ice::context c0;
+  std::vector<std::size_t> order;
+  auto co = [&](std::size_t index) -> ice::detached {
+    co_await ice::schedule(c0);
+    order.push_back(index);
+    if (order.size() == tasks) {
+      c0.stop();
+    }
+  };
+  for (std::size_t i = 0; i < tasks; i++) {
+    co(i);
+  }
+
+  auto t0 = std::thread([&]() { c0.run(); });
+  t0.join();
+  ASSERT_EQ(order.size(), tasks);
+  for (std::size_t i = 0; i < tasks; i++) {
+    EXPECT_EQ(order[i], i);
+  }
+}
+
+// Verifies that coroutines that yield on the same context resume each other in order.
+TEST(context, transfer)
+{
+  constexpr std::size_t tasks = 4;
+  constexpr std::size_t switches = 100000;
+
+  ice::context c0;
+  std::vector<std::size_t> order;
+  auto co = [&](std::size_t index) -> ice::detached {
+    co_await ice::schedule(c0, true);
+    for (std::size_t i = 0; i < switches; i++) {
+      order.push_back(index);
+      co_await ice::schedule(c0, true);
+    }
+    if (order.size() == tasks * switches) {
+      c0.stop();
+    }
+  };
+  for (std::size_t i = 0; i < tasks; i++) {
+    co(i);
+  }
+
+  auto t0 = std::thread([&]() { c0.run(); });
+  t0.join();
+  ASSERT_EQ(order.size(), tasks * switches);
+  for (std::size_t i = 0; i < order.size(); i++) {
+    EXPECT_EQ(order[i], i % tasks);
+  }
+}
+
+// Verifies that a batch of events is resumed in order from inside and outside of the context.
+TEST(context, batch)
+{
+  constexpr std::size_t tasks = 1000;
+
+  for (const auto inside : { true, false }) {
+    ice::context c0;
+    std::vector<ice::context::event*> events;
+    std::vector<std::size_t> order;
+    auto co = [&](std::size_t index) -> ice::detached {
+      co_await ice::defer{ events };
+      EXPECT_TRUE(c0.is_current());
+      order.push_back(index);
+      if (order.size() == tasks) {
+        c0.stop();
+      }
+    };
+    for (std::size_t i = 0; i < tasks; i++) {
+      co(i);
+    }
+    ASSERT_EQ(events.size(), tasks);
+
+    auto start = [&]() -> ice::detached {
+      co_await ice::schedule(c0, true);
+      c0.schedule(events.begin(), events.end());
+    };
+    if (inside) {
+      start();
+    } else {
+      c0.schedule(events.begin(), events.end());
+    }
+
+    auto t0 = std::thread([&]() { c0.run(); });
+    t0.join();
+    ASSERT_EQ(order.size(), tasks);
+    for (std::size_t i = 0; i < tasks; i++) {
+      EXPECT_EQ(order[i], i);
+    }
+  }
+}
+
+// Verifies that the statistics count resumed events and parks.
+TEST(context, stats)
+{
+  constexpr std::size_t tasks = 1000;
+
+  ice::context c0;
+  auto t0 = std::thread([&]() { c0.run(); });
+  std::size_t count = 0;
+  auto co = [&]() -> ice::detached {
+    co_await ice::schedule(c0, true);
+    if (++count == tasks) {
+      c0.stop();
+    }
+  };
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  for (std::size_t i = 0; i < tasks; i++) {
+    co();
+  }
+  t0.join();
+
+  const auto stats = c0.stats();
+  EXPECT_EQ(stats.resumed, tasks);
+  EXPECT_GE(stats.parks, 1u);
+  EXPECT_GE(stats.batch, 1u);
+  EXPECT_LE(stats.batch, tasks);
+  EXPECT_GT(stats.parked.count(), 0);
+  EXPECT_GT(stats.running.count(), 0);
+  std::uint64_t samples = 0;
+  for (const auto value : stats.latency) {
+    samples += value;
+  }
+  EXPECT_GE(samples, tasks / 64 - 1);
+}
+
+// Verifies that a coroutine that schedules itself without suspending is moved to the back of the queue after budget
+// awaits and that ice::yield always moves it.
+TEST(context, budget)
+{
+  constexpr std::size_t awaits = 10000;
+  constexpr std::uint32_t budget = 100;
+
+  for (const auto limited : { true, false }) {
+    ice::context c0{ 1, 0, limited ? budget : 0 };
+    std::size_t count = 0;
+    std::size_t seen = awaits;
+    auto loop = [&]() -> ice::detached {
+      co_await ice::schedule(c0, true);
+      for (; count < awaits; count++) {
+        co_await ice::schedule(c0);
+      }
+    };
+    auto other = [&]() -> ice::detached {
+      co_await ice::schedule(c0, true);
+      seen = count;
+      c0.stop();
+    };
+    loop();
+    other();
+    c0.run();
+    EXPECT_EQ(seen, limited ? budget : awaits);
+    EXPECT_EQ(c0.stats().yields, limited ? awaits / (budget + 1) : 0u);
+  }
+
+  ice::context c0;
+  std::vector<int> order;
+  auto co = [&](int index) -> ice::detached {
+    co_await ice::schedule(c0, true);
+    for (auto i = 0; i < 3; i++) {
+      order.push_back(index);
+      co_await ice::yield();
+    }
+  };
+  co(0);
+  co(1);
+  auto stop = [&]() -> ice::detached {
+    co_await ice::yield();
+    co_await ice::schedule(c0, true);
+    for (auto i = 0; i < 3; i++) {
+      co_await ice::yield();
+    }
+    c0.stop();
+  };
+  stop();
+  c0.run();
+  EXPECT_EQ(order, (std::vector<int>{ 0, 1, 0, 1, 0, 1 }));
+  EXPECT_EQ(c0.stats().yields, 0u);
+}
+
+// Verifies that timers expire in order and can be cancelled.
+TEST(context, timer)
+{
+  using namespace std::chrono_literals;
+  using clock = std::chrono::steady_clock;
+
+  ice::context c0;
+  std::vector<int> order;
+  std::optional<ice::sleep_for> pending;
+  auto sleep = [&](int index, std::chrono::milliseconds duration) -> ice::detached {
+    const auto start = clock::now();
+    EXPECT_TRUE(co_await ice::sleep_for(c0, duration));
+    EXPECT_GE(clock::now() - start, duration);
+    order.push_back(index);
+  };
+  auto cancel = [&]() -> ice::detached {
+    co_await ice::schedule(c0);
+    auto& timer = pending.emplace(c0, 1h);
+    EXPECT_FALSE(co_await timer);
+    order.push_back(0);
+  };
+  auto co = [&]() -> ice::detached {
+    co_await ice::schedule(c0);
+    sleep(3, 30ms);
+    sleep(1, 10ms);
+    sleep(2, 20ms);
+    co_await ice::sleep_for(c0, 5ms);
+    EXPECT_TRUE(pending->cancel());
+    co_await ice::sleep_until(c0, clock::now() + 50ms);
+    c0.stop();
+  };
+  cancel();
+  co();
+
+  auto t0 = std::thread([&]() { c0.run(); });
+  t0.join();
+  EXPECT_EQ(order, (std::vector<int>{ 0, 1, 2, 3 }));
+}
+
+// Verifies that only one of the blocked threads is woken up at each timer deadline.
+TEST(context, timer_watcher)
+{
+  using namespace std::chrono_literals;
+
+  ice::context c0{ 8 };
+  auto co = [&]() -> ice::detached {
+    co_await ice::schedule(c0);
+    for (std::size_t i = 0; i < 20; i++) {
+      EXPECT_TRUE(co_await ice::sleep_for(c0, 2ms));
+    }
+    c0.stop();
+  };
+  co();
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < 8; i++) {
+    threads.emplace_back([&]() { c0.run(); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_LT(c0.stats().parks, 100u);
+}
+
+// Verifies that high priority events are resumed first and cannot starve low priority events.
+TEST(context, priority)
+{
+  ice::context c0;
+  std::vector<ice::priority> order;
+  auto co = [&](ice::priority priority) -> ice::detached {
+    co_await ice::schedule(c0, priority);
+    order.push_back(priority);
+  };
+  for (std::size_t i = 0; i < 4; i++) {
+    co(ice::priority::low);
+    co(ice::priority::normal);
+    co(ice::priority::high);
+  }
+
+  bool done = false;
+  auto spin = [&]() -> ice::detached {
+    co_await ice::schedule(c0, ice::priority::high);
+    while (!done) {
+      co_await ice::schedule(c0, ice::priority::high, true);
+    }
+    c0.stop();
+  };
+  auto stop = [&]() -> ice::detached {
+    co_await ice::schedule(c0, ice::priority::low);
+    done = true;
+  };
+  spin();
+  stop();
+
+  auto t0 = std::thread([&]() { c0.run(); });
+  t0.join();
+  ASSERT_EQ(order.size(), 12u);
+  EXPECT_EQ(order.front(), ice::priority::high);
+  const auto low = std::find(order.begin(), order.end(), ice::priority::low);
+  EXPECT_EQ(std::count(order.begin(), low, ice::priority::high), 4);
+  EXPECT_TRUE(done);
+}
+
+// Verifies that the pool distributes coroutines over its contexts.
+TEST(context, pool)
+{
+  for (const auto policy : { ice::context_pool::policy::round_robin, ice::context_pool::policy::least_loaded }) {
+    ice::context_pool pool{ policy };
+    ASSERT_FALSE(pool.create(3));
+    ASSERT_EQ(pool.size(), 3u);
+
+    std::atomic_size_t count = 0;
+    std::atomic_size_t used[3] = {};
+    auto co = [&]() -> ice::detached {
+      co_await ice::schedule(pool);
+      for (std::size_t i = 0; i < pool.size(); i++) {
+        if (pool[i].is_current()) {
+          used[i].fetch_add(1);
+        }
+      }
+      count.fetch_add(1);
+    };
+    for (std::size_t i = 0; i < 300; i++) {
+      co();
+    }
+    while (count.load() != 300) {
+      std::this_thread::yield();
+    }
+    EXPECT_EQ(used[0] + used[1] + used[2], 300u);
+    if (policy == ice::context_pool::policy::round_robin) {
+      EXPECT_EQ(used[0], 100u);
+      EXPECT_EQ(used[1], 100u);
+      EXPECT_EQ(used[2], 100u);
+    }
+  }
+}
@@ -0,0 +1,99 @@
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <ice/generator.hpp>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// Verifies that values are produced lazily and in order.
+TEST(generator, values)
+{
+  bool started = false;
+  auto generate = [&](int size) -> ice::async_generator<std::unique_ptr<int>> {
+    started = true;
+    for (int i = 0; i < size; i++) {
+      co_yield std::make_unique<int>(i);
+    }
+  };
+  auto co = [&]() -> ice::sync<void> {
+    auto empty = generate(0);
+    EXPECT_FALSE(started);
+    EXPECT_TRUE(co_await empty.begin() == empty.end());
+    EXPECT_TRUE(started);
+
+    auto values = generate(100);
+    int expected = 0;
+    for (auto it = co_await values.begin(); it != values.end(); co_await ++it) {
+      EXPECT_EQ(**it, expected++);
+    }
+    EXPECT_EQ(expected, 100);
+  };
+  co().get();
+}
+
+// Verifies that a consumer that does not run on a context is not resumed inside co_yield, but by symmetric transfer
+// when the producer suspends because the buffer is full.
+TEST(generator, transfer)
+{
+  constexpr std::size_t capacity = 4;
+
+  std::size_t produced = 0;
+  auto generate = [&]() -> ice::async_generator<std::size_t, capacity> {
+    for (std::size_t i = 0; i < 100; i++) {
+      produced++;
+      co_yield i;
+    }
+  };
+  auto co = [&]() -> ice::sync<void> {
+    auto values = generate();
+    std::size_t expected = 0;
+    for (auto it = co_await values.begin(); it != values.end(); co_await ++it) {
+      if (expected == 0) {
+        EXPECT_EQ(produced, capacity + 1);
+      }
+      EXPECT_EQ(*it, expected++);
+    }
+    EXPECT_EQ(expected, 100u);
+  };
+  co().get();
+}
+
+// Verifies that the producer runs ahead of the consumer by at most the capacity when they run on different contexts.
+TEST(generator, context)
+{
+  constexpr std::size_t capacity = 16;
+  constexpr std::size_t size = 100000;
+
+  ice::context c0;
+  ice::context c1;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto t1 = std::thread([&]() { c1.run(); });
+  std::atomic_size_t produced = 0;
+  std::atomic_size_t consumed = 0;
+  auto generate = [&]() -> ice::async_generator<std::size_t, capacity> {
+    co_await ice::schedule(c1, true);
+    for (std::size_t i = 0; i < size; i++) {
+      EXPECT_TRUE(c1.is_current());
+      EXPECT_LE(produced.load() - consumed.load(), capacity + 1);
+      produced.fetch_add(1);
+      co_yield i;
+    }
+  };
+  auto co = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    auto values = generate();
+    std::size_t expected = 0;
+    for (auto it = co_await values.begin(); it != values.end(); co_await ++it) {
+      EXPECT_TRUE(c0.is_current());
+      EXPECT_EQ(*it, expected++);
+      consumed.fetch_add(1);
+    }
+    EXPECT_EQ(expected, size);
+    c0.stop();
+    c1.stop();
+  };
+  co().get();
+  t0.join();
+  t1.join();
+}
@@ -0,0 +1,175 @@
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <ice/mutex.hpp>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Verifies that the mutex serializes coroutines on contexts run by multiple threads.
+TEST(mutex, lock)
+{
+  constexpr std::size_t tasks = 64;
+  constexpr std::size_t iterations = 1000;
+
+  ice::context c0{ 2 };
+  ice::async_mutex mutex;
+  std::size_t value = 0;
+  std::atomic_size_t count = 0;
+  std::atomic_bool locked = false;
+  auto co = [&]() -> ice::detached {
+    co_await ice::schedule(c0, true);
+    for (std::size_t i = 0; i < iterations; i++) {
+      auto lock = co_await mutex.scoped_lock();
+      EXPECT_FALSE(locked.exchange(true));
+      value++;
+      if (i % 16 == 0) {
+        co_await ice::schedule(c0, true);
+      }
+      locked.store(false);
+    }
+    if (count.fetch_add(1) + 1 == tasks) {
+      c0.stop();
+    }
+  };
+  for (std::size_t i = 0; i < tasks; i++) {
+    co();
+  }
+  auto t0 = std::thread([&]() { c0.run(); });
+  c0.run();
+  t0.join();
+  EXPECT_EQ(value, tasks * iterations);
+  EXPECT_TRUE(mutex.try_lock());
+  EXPECT_FALSE(mutex.try_lock());
+  mutex.unlock();
+}
+
+// Verifies that waiters are resumed on the context they were suspended on.
+TEST(mutex, context)
+{
+  ice::context c0;
+  ice::context c1;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto t1 = std::thread([&]() { c1.run(); });
+  ice::async_mutex mutex;
+  ice::async_event unlock;
+  auto waiter = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c1, true);
+    co_await mutex.lock();
+    EXPECT_TRUE(c1.is_current());
+    mutex.unlock();
+  };
+  auto co = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    co_await mutex.lock();
+    auto task = waiter();
+    co_await unlock.wait();
+    EXPECT_TRUE(c0.is_current());
+    mutex.unlock();
+    task.get();
+  };
+  EXPECT_TRUE(mutex.try_lock());
+  auto task = co();
+  mutex.unlock();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  unlock.set();
+  task.get();
+  c0.stop();
+  c1.stop();
+  t0.join();
+  t1.join();
+}
+
+// Verifies that the semaphore limits the number of coroutines that hold a unit.
+TEST(mutex, semaphore)
+{
+  constexpr std::size_t units = 3;
+  constexpr std::size_t tasks = 64;
+  constexpr std::size_t iterations = 1000;
+
+  ice::context c0{ 2 };
+  ice::async_semaphore semaphore{ units };
+  std::atomic_size_t count = 0;
+  std::atomic_size_t holders = 0;
+  auto co = [&]() -> ice::detached {
+    co_await ice::schedule(c0, true);
+    for (std::size_t i = 0; i < iterations; i++) {
+      co_await semaphore.acquire();
+      EXPECT_LE(holders.fetch_add(1) + 1, units);
+      if (i % 16 == 0) {
+        co_await ice::schedule(c0, true);
+      }
+      holders.fetch_sub(1);
+      semaphore.release();
+    }
+    if (count.fetch_add(1) + 1 == tasks) {
+      c0.stop();
+    }
+  };
+  for (std::size_t i = 0; i < tasks; i++) {
+    co();
+  }
+  auto t0 = std::thread([&]() { c0.run(); });
+  c0.run();
+  t0.join();
+  for (std::size_t i = 0; i < units; i++) {
+    EXPECT_TRUE(semaphore.try_acquire());
+  }
+  EXPECT_FALSE(semaphore.try_acquire());
+}
+
+// Verifies that a manual reset event resumes all waiters and an automatic reset event resumes one waiter per set.
+TEST(mutex, event)
+{
+  ice::context c0;
+  auto t0 = std::thread([&]() { c0.run(); });
+  std::atomic_size_t count = 0;
+  auto wait = [&](ice::async_event& event) -> ice::detached {
+    co_await ice::schedule(c0, true);
+    co_await event.wait();
+    EXPECT_TRUE(c0.is_current());
+    count.fetch_add(1);
+  };
+  const auto expect = [&](std::size_t value) {
+    for (auto i = 0; i < 1000 && count.load() != value; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(count.load(), value);
+  };
+
+  ice::async_event manual;
+  EXPECT_FALSE(manual.is_set());
+  for (auto i = 0; i < 4; i++) {
+    wait(manual);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  expect(0);
+  manual.set();
+  expect(4);
+  EXPECT_TRUE(manual.try_wait());
+  wait(manual);
+  expect(5);
+  manual.reset();
+  EXPECT_FALSE(manual.try_wait());
+
+  count.store(0);
+  ice::async_event automatic{ ice::async_event::mode::automatic };
+  for (auto i = 0; i < 4; i++) {
+    wait(automatic);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  automatic.set();
+  expect(1);
+  automatic.set();
+  automatic.set();
+  expect(3);
+  automatic.set();
+  expect(4);
+  automatic.set();
+  EXPECT_TRUE(automatic.is_set());
+  EXPECT_TRUE(automatic.try_wait());
+  EXPECT_FALSE(automatic.try_wait());
+
+  c0.stop();
+  t0.join();
+}
@@ -0,0 +1,521 @@
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <ice/net/tcp/socket.hpp>
+#include <ice/net/udp/socket.hpp>
+#include <ice/scope.hpp>
+#include <ice/service.hpp>
+#include <ice/service_pool.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+
+// Verifies that data sent over a loopback connection is echoed back and that the end of the stream is reported.
+static void echo(ice::service& s0)
+{
+  constexpr std::size_t size = 4 * 1024 * 1024;
+  constexpr std::size_t chunk = 256 * 1024;
+
+  ice::context c0;
+  auto t0 = std::thread([&]() { EXPECT_FALSE(s0.run(c0)); });
+
+  ice::net::endpoint endpoint;
+  ASSERT_FALSE(endpoint.create("127.0.0.1", 0));
+  ice::net::tcp::acceptor acceptor{ s0 };
+  ASSERT_FALSE(acceptor.listen(endpoint));
+  ASSERT_FALSE(acceptor.local(endpoint));
+  EXPECT_NE(endpoint.port(), 0);
+
+  auto server = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    ice::net::tcp::socket socket{ s0 };
+    EXPECT_FALSE(co_await acceptor.accept(socket));
+    std::vector<char> buffer(64 * 1024);
+    while (true) {
+      const auto [received, ec] = co_await socket.recv(buffer.data(), buffer.size());
+      if (ec) {
+        EXPECT_EQ(ec, ice::errc::eof);
+        break;
+      }
+      const auto sent = co_await socket.send(buffer.data(), received);
+      EXPECT_FALSE(sent.ec);
+      EXPECT_EQ(sent.size, received);
+    }
+  };
+  auto client = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    ice::net::tcp::socket socket{ s0 };
+    EXPECT_FALSE(co_await socket.connect(endpoint));
+    std::vector<char> data(size);
+    std::iota(data.begin(), data.end(), 'a');
+    std::vector<char> echo(size);
+    for (std::size_t offset = 0; offset < size; offset += chunk) {
+      const auto sent = co_await socket.send(data.data() + offset, chunk);
+      EXPECT_FALSE(sent.ec);
+      EXPECT_EQ(sent.size, chunk);
+      for (std::size_t received = 0; received < chunk;) {
+        const auto result = co_await socket.recv(echo.data() + offset + received, chunk - received);
+        if (result.ec) {
+          ADD_FAILURE() << result.ec.message();
+          co_return;
+        }
+        received += result.size;
+      }
+    }
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), echo.begin()));
+    EXPECT_FALSE(socket.shutdown());
+  };
+  auto s = server();
+  client().get();
+  s.get();
+  s0.stop();
+  t0.join();
+}
+
+// Verifies that connection errors are reported.
+static void refused(ice::service& s0)
+{
+  ice::context c0;
+  auto t0 = std::thread([&]() { EXPECT_FALSE(s0.run(c0)); });
+
+  ice::net::endpoint endpoint;
+  ASSERT_FALSE(endpoint.create("::1", 0));
+  {
+    ice::net::tcp::acceptor acceptor{ s0 };
+    ASSERT_FALSE(acceptor.listen(endpoint));
+    ASSERT_FALSE(acceptor.local(endpoint));
+  }
+  auto client = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    ice::net::tcp::socket socket{ s0 };
+    EXPECT_EQ(co_await socket.connect(endpoint), ice::error_code(ECONNREFUSED));
+  };
+  client().get();
+  s0.stop();
+  t0.join();
+  EXPECT_TRUE(endpoint.create("localhost", 80));
+}
+
+// Verifies that a batch of datagrams is sent and received with the addresses of the peers.
+static void udp(ice::service& s0)
+{
+  constexpr std::size_t count = 8;
+
+  ice::context c0;
+  auto t0 = std::thread([&]() { EXPECT_FALSE(s0.run(c0)); });
+
+  ice::net::endpoint endpoint;
+  ASSERT_FALSE(endpoint.create("127.0.0.1", 0));
+  ice::net::udp::socket server{ s0 };
+  ASSERT_FALSE(server.open(endpoint));
+  ASSERT_FALSE(server.local(endpoint));
+
+  auto receive = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    std::vector<std::string> buffers(count, std::string(16, '\0'));
+    std::vector<ice::net::endpoint> endpoints(count);
+    std::vector<ice::net::udp::message> messages(count);
+    for (std::size_t i = 0; i < count; i++) {
+      messages[i] = { buffers[i].data(), buffers[i].size(), &endpoints[i] };
+    }
+    std::size_t received = 0;
+    while (received < count) {
+      const auto result = co_await server.recv(messages.data() + received, count - received);
+      if (result.ec) {
+        ADD_FAILURE() << result.ec.message();
+        co_return;
+      }
+      EXPECT_GT(result.size, 0u);
+      received += result.size;
+    }
+    for (std::size_t i = 0; i < count; i++) {
+      EXPECT_EQ(buffers[i].substr(0, messages[i].size), std::to_string(i));
+      EXPECT_EQ(messages[i].segment, 0u);
+      EXPECT_EQ(messages[i].flags, 0);
+      EXPECT_EQ(endpoints[i].port(), endpoints[0].port());
+    }
+    EXPECT_NE(endpoints[0].port(), endpoint.port());
+  };
+  auto send = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    ice::net::udp::socket client{ s0 };
+    ice::net::endpoint local;
+    EXPECT_FALSE(local.create("127.0.0.1", 0));
+    EXPECT_FALSE(client.open(local));
+    std::vector<std::string> buffers(count);
+    std::vector<ice::net::udp::message> messages(count);
+    for (std::size_t i = 0; i < count; i++) {
+      buffers[i] = std::to_string(i);
+      messages[i] = { buffers[i].data(), buffers[i].size(), &endpoint };
+    }
+    const auto result = co_await client.send(messages.data(), count);
+    EXPECT_FALSE(result.ec);
+    EXPECT_EQ(result.size, count);
+  };
+  auto r = receive();
+  send().get();
+  r.get();
+  s0.stop();
+  t0.join();
+}
+
+// Verifies that closing sockets completes their pending receive and accept operations with ECANCELED.
+static void cancel(ice::service& s0, [[maybe_unused]] bool multishot = false)
+{
+  ice::context c0;
+  auto t0 = std::thread([&]() { EXPECT_FALSE(s0.run(c0)); });
+
+  ice::net::endpoint endpoint;
+  ASSERT_FALSE(endpoint.create("127.0.0.1", 0));
+  ice::net::tcp::acceptor acceptor{ s0 };
+  ASSERT_FALSE(acceptor.listen(endpoint));
+  ASSERT_FALSE(acceptor.local(endpoint));
+
+  auto recv = [](ice::net::tcp::socket& socket) -> ice::task<> {
+    char data = 0;
+    EXPECT_EQ((co_await socket.recv(&data, 1)).ec, ice::error_code(ECANCELED));
+  };
+  auto accept = [](ice::net::tcp::acceptor& acceptor, ice::net::tcp::socket& socket) -> ice::task<> {
+    EXPECT_EQ(co_await acceptor.accept(socket), ice::error_code(ECANCELED));
+  };
+  auto co = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    ice::net::tcp::socket client{ s0 };
+    EXPECT_FALSE(co_await client.connect(endpoint));
+    ice::net::tcp::socket server{ s0 };
+    EXPECT_FALSE(co_await acceptor.accept(server));
+#if ICE_URING_MULTISHOT
+    server.set_multishot(multishot);
+#endif
+    ice::net::tcp::socket other{ s0 };
+    ice::async_scope scope;
+    scope.spawn(recv(server));
+    scope.spawn(accept(acceptor, other));
+    EXPECT_EQ(scope.size(), 2u);
+    server.close();
+    acceptor.close();
+    co_await scope.join();
+  };
+  co().get();
+  s0.stop();
+  t0.join();
+}
+
+TEST(net, echo)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create());
+  echo(s0);
+}
+
+TEST(net, refused)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create());
+  refused(s0);
+}
+
+// Verifies that a receive and a send can be pending on the same socket at the same time.
+TEST(net, duplex)
+{
+  constexpr std::size_t size = 16 * 1024 * 1024;
+
+  ice::service s0;
+  ASSERT_FALSE(s0.create());
+  ice::context c0;
+  auto t0 = std::thread([&]() { EXPECT_FALSE(s0.run(c0)); });
+
+  ice::net::endpoint endpoint;
+  ASSERT_FALSE(endpoint.create("127.0.0.1", 0));
+  ice::net::tcp::acceptor acceptor{ s0 };
+  ASSERT_FALSE(acceptor.listen(endpoint));
+  ASSERT_FALSE(acceptor.local(endpoint));
+
+  // Sends all data before receiving anything, so both peers fill their buffers and wait to send and receive at once.
+  auto send = [](ice::net::tcp::socket& socket, const std::vector<char>& data) -> ice::task<> {
+    const auto result = co_await socket.send(data.data(), data.size());
+    EXPECT_FALSE(result.ec);
+    EXPECT_EQ(result.size, data.size());
+    EXPECT_FALSE(socket.shutdown());
+  };
+  auto recv = [](ice::net::tcp::socket& socket, std::vector<char>& data) -> ice::task<> {
+    std::size_t received = 0;
+    while (true) {
+      const auto result = co_await socket.recv(data.data() + received, data.size() - received);
+      received += result.size;
+      if (result.ec) {
+        EXPECT_EQ(result.ec, ice::errc::eof);
+        break;
+      }
+    }
+    EXPECT_EQ(received, data.size());
+  };
+  auto peer = [&](bool server) -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    ice::net::tcp::socket socket{ s0 };
+    if (server) {
+      EXPECT_FALSE(co_await acceptor.accept(socket));
+    } else {
+      EXPECT_FALSE(co_await socket.connect(endpoint));
+    }
+    std::vector<char> data(size);
+    std::iota(data.begin(), data.end(), server ? 'a' : 'A');
+    std::vector<char> other(size);
+    ice::async_scope scope;
+    scope.spawn(send(socket, data));
+    scope.spawn(recv(socket, other));
+    co_await scope.join();
+    std::iota(data.begin(), data.end(), server ? 'A' : 'a');
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), other.begin()));
+  };
+  auto s = peer(true);
+  peer(false).get();
+  s.get();
+  s0.stop();
+  t0.join();
+}
+
+TEST(net, udp)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create());
+  udp(s0);
+}
+
+TEST(net, cancel)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create());
+  cancel(s0);
+}
+
+#if ICE_OS_LINUX
+
+TEST(net, udp_uring)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create(ice::service::backend_type::uring));
+  udp(s0);
+}
+
+// Verifies that a message that is split into datagrams with UDP_SEGMENT is received completely when UDP_GRO is enabled,
+// either coalesced or as separate datagrams.
+TEST(net, udp_gso)
+{
+  constexpr std::size_t segment = 1000;
+  constexpr std::size_t size = 4 * segment + 100;
+
+  ice::service s0;
+  ASSERT_FALSE(s0.create());
+  ice::context c0;
+  auto t0 = std::thread([&]() { EXPECT_FALSE(s0.run(c0)); });
+
+  ice::net::endpoint endpoint;
+  ASSERT_FALSE(endpoint.create("127.0.0.1", 0));
+  ice::net::udp::socket server{ s0 };
+  ASSERT_FALSE(server.open(endpoint));
+  ASSERT_FALSE(server.local(endpoint));
+  ASSERT_FALSE(server.set(IPPROTO_UDP, UDP_GRO, 1));
+
+  auto co = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    ice::net::udp::socket client{ s0 };
+    EXPECT_FALSE(client.create(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    std::vector<char> data(size);
+    std::iota(data.begin(), data.end(), 'a');
+    ice::net::udp::message batch{ data.data(), data.size(), &endpoint, segment };
+    const auto sent = co_await client.send(&batch, 1);
+    EXPECT_FALSE(sent.ec);
+    EXPECT_EQ(sent.size, 1u);
+
+    std::vector<char> buffer(size);
+    std::size_t received = 0;
+    while (received < size) {
+      ice::net::udp::message message{ buffer.data() + received, size - received };
+      const auto result = co_await server.recv(&message, 1);
+      if (result.ec) {
+        ADD_FAILURE() << result.ec.message();
+        co_return;
+      }
+      EXPECT_TRUE(message.segment == 0 || message.segment == segment);
+      received += message.size;
+    }
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), buffer.begin()));
+  };
+  co().get();
+  s0.stop();
+  t0.join();
+}
+
+TEST(net, echo_uring)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create(ice::service::backend_type::uring));
+  echo(s0);
+}
+
+TEST(net, echo_uring_sqpoll)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create(ice::service::backend_type::uring_sqpoll));
+  echo(s0);
+}
+
+TEST(net, refused_uring)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create(ice::service::backend_type::uring));
+  refused(s0);
+}
+
+TEST(net, cancel_uring)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create(ice::service::backend_type::uring));
+  cancel(s0);
+  cancel(s0, true);
+}
+
+#if ICE_URING_MULTISHOT
+
+// Verifies that connections accepted by the multishot operation are queued until they are awaited, that sockets with
+// multishot receive enabled read the queued data, and that queued connections and data are released with their sockets.
+TEST(net, multishot)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create(ice::service::backend_type::uring));
+  if (s0.backend() == ice::service::backend_type::epoll) {
+    GTEST_SKIP() << "io_uring is not supported";
+  }
+  ice::context c0;
+  auto t0 = std::thread([&]() { EXPECT_FALSE(s0.run(c0)); });
+
+  ice::net::endpoint endpoint;
+  ASSERT_FALSE(endpoint.create("127.0.0.1", 0));
+  auto acceptor = std::make_unique<ice::net::tcp::acceptor>(s0);
+  ASSERT_FALSE(acceptor->listen(endpoint));
+  ASSERT_FALSE(acceptor->local(endpoint));
+
+  auto co = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    std::vector<ice::net::tcp::socket> clients;
+    for (auto i = 0; i < 4; i++) {
+      clients.emplace_back(s0);
+      EXPECT_FALSE(co_await clients.back().connect(endpoint));
+      EXPECT_FALSE((co_await clients.back().send("ping", 4)).ec);
+    }
+    for (auto i = 0; i < 2; i++) {
+      ice::net::tcp::socket socket{ s0 };
+      EXPECT_FALSE(co_await acceptor->accept(socket));
+      socket.set_multishot(true);
+      char data[2] = {};
+      for (auto& c : { 'p', 'i', 'n', 'g' }) {
+        const auto result = co_await socket.recv(data, 1);
+        EXPECT_FALSE(result.ec);
+        EXPECT_EQ(result.size, 1u);
+        EXPECT_EQ(data[0], c);
+      }
+      EXPECT_FALSE(clients[i].shutdown());
+      EXPECT_EQ((co_await socket.recv(data, sizeof(data))).ec, ice::errc::eof);
+    }
+    ice::net::tcp::socket socket{ s0 };
+    EXPECT_FALSE(co_await acceptor->accept(socket));
+    socket.set_multishot(true);
+    char data[2] = {};
+    EXPECT_EQ((co_await socket.recv(data, sizeof(data))).size, 2u);
+    acceptor.reset();
+  };
+  co().get();
+  s0.stop();
+  t0.join();
+}
+
+#endif
+
+// Verifies that connections to acceptors that share a port are spread over the shards of a pool and handled by the
+// shard that accepted them.
+TEST(net, sharded)
+{
+  constexpr std::size_t shards = 4;
+  constexpr std::size_t connections = 64;
+
+  for (const auto backend : { ice::service::backend_type::epoll, ice::service::backend_type::uring }) {
+    ice::service_pool pool;
+    ASSERT_FALSE(pool.create(shards, backend));
+
+    ice::net::endpoint endpoint;
+    ASSERT_FALSE(endpoint.create("127.0.0.1", 0));
+    std::vector<ice::net::tcp::acceptor> acceptors;
+    for (std::size_t i = 0; i < shards; i++) {
+      acceptors.emplace_back(pool[i].service());
+      ASSERT_FALSE(acceptors.back().listen(endpoint, SOMAXCONN, true));
+      ASSERT_FALSE(acceptors.back().local(endpoint));
+    }
+
+    std::vector<std::atomic_size_t> accepted(shards);
+    auto handler = [](ice::service_pool::shard& shard, ice::net::tcp::socket socket) -> ice::task<> {
+      char data = 0;
+      EXPECT_FALSE((co_await socket.recv(&data, 1)).ec);
+      EXPECT_TRUE(shard.context().is_current());
+      EXPECT_FALSE((co_await socket.send(&data, 1)).ec);
+    };
+    auto server = [&](std::size_t index) -> ice::sync<void> {
+      auto& shard = pool[index];
+      co_await ice::schedule(shard.context(), true);
+      ice::async_scope scope;
+      while (true) {
+        ice::net::tcp::socket socket{ shard.service() };
+        if (const auto ec = co_await acceptors[index].accept(socket)) {
+          EXPECT_EQ(ec, ice::error_code(ECANCELED));
+          break;
+        }
+        EXPECT_TRUE(shard.context().is_current());
+        accepted[index].fetch_add(1);
+        scope.spawn(handler(shard, std::move(socket)));
+      }
+      co_await scope.join();
+    };
+    auto client = [&]() -> ice::sync<void> {
+      for (std::size_t i = 0; i < connections; i++) {
+        auto& shard = pool.next();
+        co_await ice::schedule(shard.context(), true);
+        ice::net::tcp::socket socket{ shard.service() };
+        EXPECT_FALSE(co_await socket.connect(endpoint));
+        char data = 'x';
+        EXPECT_FALSE((co_await socket.send(&data, 1)).ec);
+        EXPECT_EQ((co_await socket.recv(&data, 1)).size, 1u);
+      }
+    };
+    std::vector<ice::sync<void>> servers;
+    for (std::size_t i = 0; i < shards; i++) {
+      servers.push_back(server(i));
+    }
+    client().get();
+
+    auto close = [&](std::size_t index) -> ice::sync<void> {
+      co_await ice::schedule(pool[index].context(), true);
+      acceptors[index].close();
+    };
+    for (std::size_t i = 0; i < shards; i++) {
+      close(i).get();
+    }
+    for (auto& server : servers) {
+      server.get();
+    }
+    std::size_t total = 0;
+    std::size_t used = 0;
+    for (const auto& count : accepted) {
+      total += count.load();
+      used += count.load() ? 1 : 0;
+    }
+    EXPECT_EQ(total, connections);
+    EXPECT_GT(used, 1u);
+  }
+}
+
+#endif
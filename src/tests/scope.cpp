@@ -0,0 +1,123 @@
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <ice/mutex.hpp>
+#include <ice/scope.hpp>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+// Verifies that join waits for all spawned tasks and resumes the awaiter on its context.
+TEST(scope, join)
+{
+  constexpr std::size_t tasks = 1000;
+
+  ice::context c0{ 2 };
+  ice::context c1;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto t1 = std::thread([&]() { c0.run(); });
+  auto t2 = std::thread([&]() { c1.run(); });
+  ice::async_scope scope;
+  std::atomic_size_t count = 0;
+  auto work = [&]() -> ice::task<> {
+    co_await ice::schedule(c0, true);
+    count.fetch_add(1);
+  };
+  auto co = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c1, true);
+    for (std::size_t i = 0; i < tasks; i++) {
+      EXPECT_TRUE(scope.spawn(work()));
+    }
+    co_await scope.join();
+    EXPECT_TRUE(c1.is_current());
+    EXPECT_EQ(count.load(), tasks);
+    EXPECT_EQ(scope.size(), 0u);
+
+    co_await scope.join();
+    EXPECT_TRUE(scope.spawn(work()));
+    co_await scope.join();
+    EXPECT_EQ(count.load(), tasks + 1);
+  };
+  co().get();
+  c0.stop();
+  c1.stop();
+  t0.join();
+  t1.join();
+  t2.join();
+}
+
+// Verifies that the limit rejects work while too many tasks are in flight.
+TEST(scope, limit)
+{
+  ice::async_scope scope{ 2 };
+  ice::async_event event;
+  std::size_t count = 0;
+  auto work = [&]() -> ice::task<> {
+    co_await event.wait();
+    count++;
+  };
+  auto co = [&]() -> ice::sync<void> {
+    EXPECT_TRUE(scope.spawn(work()));
+    EXPECT_TRUE(scope.spawn(work()));
+    EXPECT_FALSE(scope.spawn(work()));
+    EXPECT_EQ(scope.size(), 2u);
+    event.set();
+    co_await scope.join();
+    EXPECT_EQ(count, 2u);
+    EXPECT_TRUE(scope.spawn(work()));
+    co_await scope.join();
+    EXPECT_EQ(count, 3u);
+  };
+  co().get();
+}
+
+// Verifies that work spawned from another context while join is pending or completing does not resume the awaiter of
+// join twice and is counted correctly.
+TEST(scope, spawn_during_join)
+{
+  constexpr std::size_t joins = 1000;
+  constexpr std::size_t tasks = 100000;
+
+  ice::context c0;
+  ice::context c1;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto t1 = std::thread([&]() { c1.run(); });
+  ice::async_scope scope;
+  std::atomic_size_t count = 0;
+  auto work = [&]() -> ice::task<> {
+    co_await ice::schedule(c0, true);
+    count.fetch_add(1);
+  };
+  // Interleaves spawning with the completion of the spawned tasks, so that new work is spawned right after the last
+  // task in flight completed a pending join.
+  auto spawner = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+    for (std::size_t i = 0; i < tasks; i++) {
+      EXPECT_TRUE(scope.spawn(work()));
+      EXPECT_LE(scope.size(), tasks);
+      co_await ice::schedule(c0, true);
+    }
+  };
+  std::size_t joined = 0;
+  auto joiner = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c1, true);
+    for (std::size_t i = 0; i < joins; i++) {
+      co_await scope.join();
+      EXPECT_TRUE(c1.is_current());
+      joined++;
+    }
+  };
+  auto s = spawner();
+  joiner().get();
+  s.get();
+  EXPECT_EQ(joined, joins);
+  auto co = [&]() -> ice::sync<void> {
+    co_await scope.join();
+  };
+  co().get();
+  EXPECT_EQ(count.load(), tasks);
+  EXPECT_EQ(scope.size(), 0u);
+  c0.stop();
+  c1.stop();
+  t0.join();
+  t1.join();
+}
@@ -0,0 +1,147 @@
+#include <ice/async.hpp>
+#include <ice/context.hpp>
+#include <ice/service.hpp>
+#include <ice/service_pool.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Verifies that a context attached to a service is run by the service thread.
+TEST(service, context)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create());
+  ice::context c0;
+  ice::error_code ec;
+  auto t0 = std::thread([&]() { ec = s0.run(c0); });
+
+  auto task = [&]() -> ice::sync<void> {
+    EXPECT_FALSE(c0.is_current());
+    co_await ice::schedule(c0, true);
+    EXPECT_EQ(std::this_thread::get_id(), t0.get_id());
+    EXPECT_TRUE(c0.is_current());
+
+    const auto start = ice::sleep_for::clock::now();
+    EXPECT_TRUE(co_await ice::sleep_for(c0, std::chrono::milliseconds(10)));
+    EXPECT_GE(ice::sleep_for::clock::now() - start, std::chrono::milliseconds(10));
+    EXPECT_EQ(std::this_thread::get_id(), t0.get_id());
+  };
+  auto co = task();
+  co.get();
+
+  s0.stop();
+  t0.join();
+  EXPECT_FALSE(ec);
+}
+
+// Verifies that timers of an attached context are not rounded up to whole milliseconds by the service wait.
+TEST(service, timer)
+{
+  using namespace std::chrono_literals;
+
+  std::vector<ice::service> services(1);
+  ASSERT_FALSE(services[0].create());
+#if ICE_OS_LINUX
+  services.emplace_back();
+  ASSERT_FALSE(services[1].create(ice::service::backend_type::uring));
+#endif
+  for (auto& s0 : services) {
+    ice::context c0;
+    auto t0 = std::thread([&]() { EXPECT_FALSE(s0.run(c0)); });
+    auto co = [&]() -> ice::sync<void> {
+      co_await ice::schedule(c0, true);
+      const auto start = ice::sleep_for::clock::now();
+      for (auto i = 0; i < 20; i++) {
+        EXPECT_TRUE(co_await ice::sleep_for(c0, 100us));
+      }
+      const auto elapsed = ice::sleep_for::clock::now() - start;
+      EXPECT_GE(elapsed, 2ms);
+      EXPECT_LT(elapsed, 15ms);
+    };
+    co().get();
+    s0.stop();
+    t0.join();
+  }
+}
+
+// Verifies that a service can be moved after it was created and still be woken up to resume events of the attached
+// context.
+TEST(service, move)
+{
+  std::vector<ice::service> services(1);
+  ASSERT_FALSE(services[0].create());
+#if ICE_OS_LINUX
+  services.emplace_back();
+  ASSERT_FALSE(services[1].create(ice::service::backend_type::uring));
+#endif
+  for (auto& service : services) {
+    ice::service s0 = std::move(service);
+    ice::context c0;
+    auto t0 = std::thread([&]() { EXPECT_FALSE(s0.run(c0)); });
+    auto co = [&]() -> ice::sync<void> {
+      co_await ice::schedule(c0, true);
+      EXPECT_TRUE(c0.is_current());
+    };
+    for (auto i = 0; i < 10; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      co().get();
+    }
+    s0.stop();
+    t0.join();
+  }
+}
+
+// Verifies that stopping an attached context stops the service run loop.
+TEST(service, stop)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create());
+  ice::context c0;
+  auto t0 = std::thread([&]() { EXPECT_FALSE(s0.run(c0)); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  c0.stop();
+  t0.join();
+}
+
+// Verifies that the worker of a context is released when a run loop returns and that a context is not run by more
+// threads than its concurrency allows.
+TEST(service, rerun)
+{
+  ice::service s0;
+  ASSERT_FALSE(s0.create());
+  ice::context c0;
+  auto t0 = std::thread([&]() { c0.run(); });
+  auto co = [&]() -> ice::sync<void> {
+    co_await ice::schedule(c0, true);
+  };
+  co().get();
+  EXPECT_EQ(s0.run(c0), ice::error_code(std::errc::device_or_resource_busy));
+  c0.stop();
+  t0.join();
+
+  c0.run();
+  EXPECT_FALSE(s0.run(c0));
+  c0.run();
+}
+
+// Verifies that every shard of a pool runs its context on its own thread.
+TEST(service, pool)
+{
+  ice::service_pool pool;
+  ASSERT_FALSE(pool.create(3));
+  ASSERT_EQ(pool.size(), 3u);
+  std::vector<std::thread::id> threads;
+  auto co = [&]() -> ice::sync<void> {
+    for (std::size_t i = 0; i < pool.size(); i++) {
+      co_await ice::schedule(pool.next().context(), true);
+      EXPECT_TRUE(pool[i].context().is_current());
+      threads.push_back(std::this_thread::get_id());
+    }
+  };
+  co().get();
+  for (std::size_t i = 0; i < threads.size(); i++) {
+    EXPECT_EQ(std::count(threads.begin(), threads.end(), threads[i]), 1);
+  }
+}